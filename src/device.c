@@ -27,6 +27,7 @@
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <plist/plist.h>
 #include <glib.h>
@@ -162,7 +163,7 @@ gboolean device_sbs_get_iconstate(sbservices_client_t sbc, plist_t *iconstate, c
     return ret;
 }
 
-gboolean device_sbs_save_icon(sbservices_client_t sbc, char *display_identifier, char *filename, GError **error)
+gboolean device_sbs_save_icon(sbservices_client_t sbc, const char *display_identifier, const char *filename, GError **error)
 {
     gboolean res = FALSE;
     char *png = NULL;
@@ -181,6 +182,35 @@ gboolean device_sbs_save_icon(sbservices_client_t sbc, char *display_identifier,
     return res;
 }
 
+gboolean device_sbs_refresh_icon(sbservices_client_t sbc, const char *display_identifier, const char *filename, gboolean *changed, GError **error)
+{
+    gboolean res = FALSE;
+    char *png = NULL;
+    uint64_t pngsize = 0;
+
+    *changed = FALSE;
+    if ((sbservices_get_icon_pngdata(sbc, display_identifier, &png, &pngsize) == SBSERVICES_E_SUCCESS) && (pngsize > 0)) {
+        gchar *cached = NULL;
+        gsize cachedsize = 0;
+
+        /* only rewrite the cached icon if the device sent something new */
+        if (g_file_get_contents(filename, &cached, &cachedsize, NULL) && (cachedsize == pngsize) && (memcmp(cached, png, pngsize) == 0)) {
+            res = TRUE;
+        } else {
+            res = g_file_set_contents(filename, png, pngsize, error);
+            *changed = res;
+        }
+        g_free(cached);
+    } else {
+        if (error)
+            *error = g_error_new(device_domain, EIO, _("Could not get icon png data for '%s'"), display_identifier);
+    }
+    if (png) {
+        free(png);
+    }
+    return res;
+}
+
 gboolean device_sbs_set_iconstate(sbservices_client_t sbc, plist_t iconstate, GError **error)
 {
     gboolean result = FALSE;
@@ -202,6 +232,27 @@ gboolean device_sbs_set_iconstate(sbservices_client_t sbc, plist_t iconstate, GE
     return result;
 }
 
+static char *device_cache_filename(const char *subdir, const char *uuid, const char *extension)
+{
+    char *path;
+    char *filename;
+
+    path = g_build_filename(g_get_user_cache_dir(),
+                            "libimobiledevice",
+                            subdir, NULL);
+    g_mkdir_with_parents(path, 0755);
+    g_free(path);
+
+    filename = g_strdup_printf("%s.%s", uuid, extension);
+    path = g_build_filename(g_get_user_cache_dir(),
+                            "libimobiledevice",
+                            subdir,
+                            filename, NULL);
+    g_free(filename);
+
+    return path;
+}
+
 #ifdef HAVE_LIBIMOBILEDEVICE_1_1
 char *device_sbs_save_wallpaper(sbservices_client_t sbc, const char *uuid, GError **error)
 {
@@ -211,24 +262,10 @@ char *device_sbs_save_wallpaper(sbservices_client_t sbc, const char *uuid, GErro
 
     if ((sbservices_get_home_screen_wallpaper_pngdata(sbc, &png, &pngsize) == SBSERVICES_E_SUCCESS) && (pngsize > 0)) {
         /* save png icon to disk */
-        char *path;
-        char *filename;
-
-	path = g_build_filename (g_get_user_cache_dir (),
-				 "libimobiledevice",
-				 "wallpaper", NULL);
-	g_mkdir_with_parents (path, 0755);
-	g_free (path);
-
-	filename = g_strdup_printf ("%s.png", uuid);
-	path = g_build_filename (g_get_user_cache_dir (),
-				 "libimobiledevice",
-				 "wallpaper",
-				 filename, NULL);
-        g_free (filename);
+        char *path = device_cache_filename("wallpaper", uuid, "png");
 
         if (g_file_set_contents (path, png, pngsize, error) == FALSE) {
-          g_free (filename);
+          g_free (path);
           free (png);
           return NULL;
 	}
@@ -244,6 +281,88 @@ char *device_sbs_save_wallpaper(sbservices_client_t sbc, const char *uuid, GErro
 }
 #endif
 
+char *device_get_cached_wallpaper(const char *uuid)
+{
+    char *path = device_cache_filename("wallpaper", uuid, "png");
+
+    if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+        g_free(path);
+        return NULL;
+    }
+    return path;
+}
+
+gboolean device_load_cached_iconstate(const char *uuid, plist_t *iconstate, char **format_version)
+{
+    gboolean res = FALSE;
+    gchar *data = NULL;
+    gsize size = 0;
+    plist_t root = NULL;
+    char *path;
+
+    *iconstate = NULL;
+    *format_version = NULL;
+
+    path = device_cache_filename("iconstate", uuid, "plist");
+    if (g_file_get_contents(path, &data, &size, NULL) && (size > 0)) {
+        plist_from_bin(data, size, &root);
+    }
+    g_free(data);
+    g_free(path);
+
+    if (root && (plist_get_node_type(root) == PLIST_DICT)) {
+        plist_t node = plist_dict_get_item(root, "iconState");
+        if (node && (plist_get_node_type(node) == PLIST_ARRAY)) {
+            *iconstate = plist_copy(node);
+            node = plist_dict_get_item(root, "formatVersion");
+            if (node && (plist_get_node_type(node) == PLIST_STRING)) {
+                plist_get_string_val(node, format_version);
+            }
+            res = TRUE;
+        }
+    }
+    if (root) {
+        plist_free(root);
+    }
+    return res;
+}
+
+gboolean device_save_cached_iconstate(const char *uuid, plist_t iconstate, const char *format_version, GError **error)
+{
+    gboolean res = FALSE;
+    char *data = NULL;
+    uint32_t size = 0;
+    plist_t root;
+
+    if (!iconstate) {
+        return res;
+    }
+
+    root = plist_new_dict();
+    plist_dict_insert_item(root, "formatVersion", plist_new_string(format_version ? format_version : "1"));
+    plist_dict_insert_item(root, "iconState", plist_copy(iconstate));
+    plist_to_bin(root, &data, &size);
+    plist_free(root);
+
+    if (data) {
+        res = device_save_cached_iconstate_data(uuid, data, size, error);
+        free(data);
+    }
+    return res;
+}
+
+/* data is a binary plist dict with formatVersion and iconState */
+gboolean device_save_cached_iconstate_data(const char *uuid, const char *data, gsize size, GError **error)
+{
+    gboolean res;
+    char *path = device_cache_filename("iconstate", uuid, "plist");
+
+    res = g_file_set_contents(path, data, size, error);
+    g_free(path);
+
+    return res;
+}
+
 device_info_t device_info_new()
 {
     device_info_t device_info = g_new0(struct device_info_int, 1);
@@ -51,10 +51,16 @@ void device_init();
 sbservices_client_t device_sbs_new(const char *uuid, uint32_t *osversion, GError **error);
 void device_sbs_free(sbservices_client_t sbc);
 gboolean device_sbs_get_iconstate(sbservices_client_t sbc, plist_t *iconstate, const char *format_version, GError **error);
-gboolean device_sbs_save_icon(sbservices_client_t sbc, char *display_identifier, char *filename, GError **error);
+gboolean device_sbs_save_icon(sbservices_client_t sbc, const char *display_identifier, const char *filename, GError **error);
+gboolean device_sbs_refresh_icon(sbservices_client_t sbc, const char *display_identifier, const char *filename, gboolean *changed, GError **error);
 gboolean device_sbs_set_iconstate(sbservices_client_t sbc, plist_t iconstate, GError **error);
 char *device_sbs_save_wallpaper(sbservices_client_t sbc, const char *uuid, GError **error);
 
+char *device_get_cached_wallpaper(const char *uuid);
+gboolean device_load_cached_iconstate(const char *uuid, plist_t *iconstate, char **format_version);
+gboolean device_save_cached_iconstate(const char *uuid, plist_t iconstate, const char *format_version, GError **error);
+gboolean device_save_cached_iconstate_data(const char *uuid, const char *data, gsize size, GError **error);
+
 device_info_t device_info_new();
 void device_info_free(device_info_t device_info);
 gboolean device_poll_battery_capacity(const char *uuid, device_info_t *device_info, GError **error);
@@ -44,6 +44,13 @@
 #include "utility.h"
 #include "device.h"
 #include "sbitem.h"
+#include "sbiconactor.h"
+#include "sbpage.h"
+#include "sblayout.h"
+#include "icondecoder.h"
+#include "iconatlas.h"
+#include "labelcache.h"
+#include "iconstate.h"
 #include "gui.h"
 
 #define MIN(a, b) (((a) < (b)) ? (a) : (b)) 
@@ -52,12 +59,20 @@
 #define STAGE_WIDTH 320
 #define STAGE_HEIGHT 480
 #define DOCK_HEIGHT 90
-#define MAX_PAGE_ITEMS (gint)(device_info->home_screen_icon_rows*device_info->home_screen_icon_columns+device_info->home_screen_icon_dock_max_count)
+#define PAGE_ITEMS (guint)(device_info->home_screen_icon_rows*device_info->home_screen_icon_columns)
 #define ICON_SPACING 18
 #define PAGE_X_OFFSET(i) ((gfloat)(i)*(gfloat)(stage_area.x2))
+#define PAGE_ROW_HEIGHT ((gfloat)(device_info->home_screen_icon_height + ICON_SPACING))
+#define FOLDER_ITEMS (guint)(device_info->icon_folder_rows*device_info->icon_folder_columns)
+/* grid of the open folder, rows include the label */
+#define ICON_ROW_HEIGHT ((gfloat)(device_info->home_screen_icon_height + 31))
+#define FOLDER_MINI_SCALE 0.22
+#define FOLDER_MINI_WIDTH ((gint)(device_info->home_screen_icon_width * FOLDER_MINI_SCALE + 0.5))
+#define ICON_COLUMN_WIDTH(columns) ((gfloat)(STAGE_WIDTH - 16) / (gfloat)(columns))
 
 #define ICON_MOVEMENT_DURATION 250
 #define FOLDER_ANIM_DURATION 500
+#define FOLDER_DOTS_HEIGHT 14.0
 
 const char CLOCK_FONT[] = "FreeSans Bold 12px";
 ClutterColor clock_text_color = { 255, 255, 255, 210 };
@@ -99,31 +114,155 @@ GMutex *selected_mutex = NULL;
 SBItem *selected_item = NULL;
 
 SBItem *selected_folder = NULL;
+/* the page of selected_folder that is shown */
+static guint folder_page = 0;
+
+/* pages to align before the next frame */
+static GHashTable *align_pending = NULL;
+static gboolean align_dock_pending = FALSE;
+static guint align_repaint_id = 0;
+
+/* only the current page and its neighbours have visible actors, icon
+ * textures are kept for the PAGE_RESIDENT_MAX most recently shown pages */
+#define PAGE_RESIDENT_MAX 5
+static GQueue *resident_pages = NULL;
+static gint page_slide_from = -1;
+static guint page_evictions = 0;
+static guint page_reloads = 0;
 
 ClutterActor *folder_marker = NULL;
 
 ClutterActor *aniupper = NULL;
 ClutterActor *anilower = NULL;
 ClutterActor *folder = NULL;
+/* page dots of the open folder, part of the folder group */
+static ClutterActor *folder_page_dots = NULL;
 gfloat split_pos = 0.0;
 
 GMutex *icon_loader_mutex = NULL;
 static int icons_loaded = 0;
 static int total_icons = 0;
 
+/* icons are decoded on worker threads, in the order they were loaded */
+#define ICON_DECODE_THREADS 2
+static IconDecoder *icon_decoder = NULL;
+static guint icon_decode_seq = 0;
+
+/* decoded icons wait here to be uploaded within a time budget per frame */
+#define UPLOAD_FRAME_BUDGET 4000
+#define FRAME_TIME 16667
+static GAsyncQueue *upload_queue = NULL;
+static volatile gint upload_scheduled = 0;
+static gint64 upload_last_frame = 0;
+static gboolean upload_last_frame_busy = FALSE;
+
+typedef struct {
+    guint uploads;
+    guint frames;
+    guint missed_frames;
+    gint64 upload_time;
+    gint64 max_frame_time;
+} SBUploadStats;
+static SBUploadStats upload_stats;
+
+/* icon labels are rendered once per text and color */
+static LabelCache *label_cache = NULL;
+
+/* uploaded icons share a few large textures */
+static IconAtlas *icon_atlas = NULL;
+static guint icon_atlas_compact_source = 0;
+/* the reduced copies the folder previews are drawn from */
+static IconAtlas *mini_atlas = NULL;
+
+/* warm start from the cached icon state */
+static gboolean use_icon_cache = FALSE;
+static GHashTable *reuse_items = NULL;
+static GHashTable *reuse_folders = NULL;
+static GHashTable *reused_items = NULL;
+static guint load_generation = 0;
+
+/* kept icons are checked for changes one at a time on a single worker */
+static GThreadPool *icon_refresh_pool = NULL;
+
+/* work on an item that finishes in the main loop, where it is dropped if
+ * the pages have been reloaded since, the item is gone by then */
+typedef struct {
+    SBItem *item;
+    guint generation;
+    const char *icon_filename;
+    const char *display_identifier;
+} SBItemJob;
+
+/* the fetch thread owns client until it is handed back to the main loop */
+typedef struct {
+    guint generation;
+    char *uuid;
+    sbservices_client_t client;
+    uint32_t osversion;
+    const char *format_version;
+    plist_t iconstate;
+    char *wallpaper;
+    gboolean warm;
+} SBFetchData;
+
 gfloat start_x = 0.0;
 gfloat start_y = 0.0;
 
-gboolean move_left = TRUE;
-
-GList *dockitems = NULL;
-GList *sbpages = NULL;
+/* slot geometry of the drop targets, set up when a drag starts */
+typedef struct {
+    gfloat x;
+    gfloat y;
+    gfloat col_width;
+    gfloat row_height;
+    gint columns;
+    gint rows;
+} SlotGrid;
+
+static SlotGrid page_grid;
+static SlotGrid dock_grid;
+static SlotGrid folder_grid;
+
+/* where the dragged item has been put last */
+static SBPage *drop_list = NULL;
+static gint drop_slot = -1;
+
+/* the drop target follows the pointer at most once per frame */
+static guint drag_update_id = 0;
+static guint drag_motion_events = 0;
+static guint drag_reflows = 0;
+
+/* icon movements, one transition per icon that is retargeted in place */
+static guint icon_anim_created = 0;
+static guint icon_anim_retargeted = 0;
+static guint icon_anim_skipped = 0;
+
+SBPage *dockitems = NULL;
+GPtrArray *sbpages = NULL;
+
+/* storage for items and pages, recycled as a whole on every reload */
+#define POOL_PAGE_SLOTS 32
+static SBPool *item_pool = NULL;
+static SBPool *page_pool = NULL;
+static SBPool *slot_pool = NULL;
+
+static PlistWriter *iconstate_writer = NULL;
+
+/* displayIdentifier -> SBItem, the item itself knows where it is */
+static GHashTable *item_index = NULL;
+
+/* undo/redo, the newest snapshot is at the head of each queue */
+#define UNDO_LEVELS 100
+static SBLayout *layout_current = NULL;
+static GQueue *undo_history = NULL;
+static GQueue *redo_history = NULL;
 
 guint num_dock_items = 0;
 
 sbservices_client_t sbc = NULL;
 uint32_t osversion = 0;
 device_info_t device_info = NULL;
+/* until the device answered, device_info only holds defaults */
+static gboolean device_limits_known = FALSE;
 
 static finished_cb_t finished_callback = NULL;
 static device_info_cb_t device_info_callback = NULL;
@@ -135,31 +274,92 @@ static int gui_deinitialized = 0;
 static int clutter_threads_initialized = 0;
 static int clutter_initialized = 0;
 
-static void gui_page_indicator_group_add(GList *page, int page_index);
+static void gui_page_indicator_group_add(SBPage *page, int page_index);
 static void gui_page_align_icons(guint page_num, gboolean animated);
 static void gui_folder_align_icons(SBItem *item, gboolean animated);
+static void gui_item_move_to_dock(SBItem *item, gboolean is_dock_item);
+static void gui_item_take_out_of_folder(SBItem *item);
+static void gui_folder_redraw_subitems(SBItem *item);
+static void gui_history_reset();
+static void gui_history_record();
+static guint gui_load_item_texture(SBItem *item);
 
 /* helper */
-static void sbpage_free(GList *sbitems, gpointer data)
+static SBPage *gui_get_page(guint page_num)
 {
-    if (sbitems) {
-        g_list_foreach(sbitems, (GFunc) (g_func_sbitem_free), NULL);
-        g_list_free(sbitems);
-        clutter_group_remove_all(CLUTTER_GROUP(page_indicator_group));
+    if (page_num >= sbpages->len) {
+        return NULL;
+    }
+    return (SBPage*)g_ptr_array_index(sbpages, page_num);
+}
+
+static SBPage *gui_pages_append()
+{
+    SBPage *page = sbpage_new(PAGE_ITEMS);
+    page->index = sbpages->len;
+    g_ptr_array_add(sbpages, page);
+    return page;
+}
+
+static void gui_item_destroy_actors(gpointer data)
+{
+    SBItem *item = (SBItem*)data;
+
+    if (item->texture && CLUTTER_IS_ACTOR(item->texture)) {
+        /* a pending decode must not touch the item anymore */
+        g_object_set_data(G_OBJECT(item->texture), "sbitem", NULL);
+        ClutterActor *parent = clutter_actor_get_parent(item->texture);
+        if (parent) {
+            clutter_actor_destroy(parent);
+            item->texture = NULL;
+        } else {
+            clutter_actor_destroy(item->texture);
+            item->texture = NULL;
+        }
     }
+    if (item->label) {
+        label_cache_unref(label_cache, item->label);
+        item->label = NULL;
+    }
+    if (item->mini_texture) {
+        g_object_unref(item->mini_texture);
+        item->mini_texture = NULL;
+    }
+}
+
+/* label is a reference from the label cache, painted by the icon */
+static void gui_item_set_label(SBItem *item, ClutterActor *label)
+{
+    item->label = label;
+    sb_icon_actor_set_label(SB_ICON_ACTOR(item->texture), label);
 }
 
 static void pages_free()
 {
-    if (sbpages) {
-        g_list_foreach(sbpages, (GFunc)(sbpage_free), NULL);
-        g_list_free(sbpages);
-        sbpages = NULL;
+    guint i;
+
+    /* results of loads still in flight are stale from now on */
+    load_generation++;
+    g_queue_clear(resident_pages);
+    page_slide_from = -1;
+    /* only what lives outside the pools is freed one by one */
+    for (i = 0; i < sbpages->len; i++) {
+        sbpage_release(gui_get_page(i), TRUE);
+    }
+    if (sbpages->len > 0) {
+        g_ptr_array_set_size(sbpages, 0);
+        clutter_group_remove_all(CLUTTER_GROUP(page_indicator_group));
     }
     if (dockitems) {
-        sbpage_free(dockitems, NULL);
+        sbpage_release(dockitems, TRUE);
         dockitems = NULL;
     }
+    g_hash_table_remove_all(item_index);
+    gui_history_reset();
+    /* nothing allocated from the pools is alive anymore */
+    sbpool_reset(item_pool);
+    sbpool_reset(page_pool);
+    sbpool_reset(slot_pool);
     if (wallpaper) {
         clutter_actor_destroy(wallpaper);
         wallpaper = NULL;
@@ -186,120 +386,55 @@ static void clutter_actor_get_abs_center(ClutterActor *actor, gfloat *center_x,
     *center_y += clutter_actor_get_y(actor);
 }
 
-static GList *iconlist_insert_item_at(GList *iconlist, SBItem *newitem, gfloat item_x, gfloat item_y, int pageindex, int icons_per_row)
+static void gui_pages_reflow(guint page_num)
 {
-    if (!newitem) {
-        return iconlist;
-    }
-    
-    debug_printf("%s: count items %d\n", __func__, g_list_length(iconlist));
-    
-    if (!iconlist) {
-        debug_printf("%s: appending item\n", __func__);
-        /* for empty lists just add the element */
-        return g_list_append(iconlist, newitem);
-    }
-    gint i;
-    gint count = g_list_length(iconlist);
-    gint newpos = count;
-    if (count <= 0) {
-        return iconlist;
-    }
-
-    gfloat xpageoffset = PAGE_X_OFFSET(pageindex);
-
-    gfloat spacing = ICON_SPACING;
-    if (icons_per_row > (gint)device_info->home_screen_icon_columns) {
-        spacing = 3;
-    }
-
-    gfloat xpos = spacing + xpageoffset;
-    gfloat ypos = ICON_SPACING;
-    gfloat oxpos = xpos;
-
-    for (i = 0; i < count; i++) {
-        oxpos = xpos;
-
-        gint nrow = (ypos - ICON_SPACING) / 88;
-        gint irow = (item_y - ICON_SPACING) / 88;
-
-        oxpos += nrow*stage_area.x2;
-        gfloat ixpos = item_x + irow*stage_area.x2;
-
-        /* if required, add spacing */
-        if (!move_left)
-            oxpos += spacing;
+    guint i;
 
-        if (ixpos < oxpos + 75) {
-            newpos = i;
+    /* push items that do not fit anymore to the front of the next page */
+    for (i = page_num; i < sbpages->len; i++) {
+        SBPage *page = gui_get_page(i);
+        SBPage *next;
+        if (page->count <= PAGE_ITEMS) {
             break;
         }
-
-        if (((i + 1) % icons_per_row) == 0) {
-            xpos = spacing + xpageoffset;
-            if (ypos + 88.0 < sb_area.y2 - sb_area.y1) {
-                ypos += 88.0;
-            }
-        } else {
-            xpos += 75;
-            xpos += spacing;
+        next = gui_get_page(i + 1);
+        if (!next) {
+            debug_printf("%s: last page is full, appending page\n", __func__);
+            next = gui_pages_append();
+            gui_page_indicator_group_add(next, i + 1);
         }
+        while (page->count > PAGE_ITEMS) {
+            sbpage_insert_item(next, sbpage_remove_index(page, page->count - 1), 0);
+        }
+        gui_page_align_icons(i + 1, TRUE);
+    }
+}
+
+static void iconlist_insert_item_at(SBPage *iconlist, SBItem *newitem, gint newpos, int pageindex)
+{
+    if (!iconlist || !newitem) {
+        return;
     }
 
+    newpos = MIN(newpos, (gint)iconlist->count);
     debug_printf("%s: newpos:%d\n", __func__, newpos);
 
+    if (pageindex < 0) {
+        sbpage_insert_item(iconlist, newitem, newpos);
+        return;
+    }
+
+    /* the dragged item always stays on the page it is dropped on */
+    if (newpos >= (gint)PAGE_ITEMS) {
+        newpos = PAGE_ITEMS - 1;
+    }
+    sbpage_insert_item(iconlist, newitem, newpos);
+
     /* do we have a full page? */
-    if ((count >= MAX_PAGE_ITEMS) && (icons_per_row == (gint)device_info->home_screen_icon_columns)) {
+    if (iconlist->count > PAGE_ITEMS) {
         debug_printf("%s: full page detected\n", __func__);
-        /* remove overlapping item from current page */
-        SBItem *last_item = g_list_nth_data(iconlist, MAX_PAGE_ITEMS-1);
-        iconlist = g_list_remove(iconlist, last_item);
-        /* animate it to new position */
-        ClutterActor *actor = clutter_actor_get_parent(last_item->texture);
-        clutter_actor_animate(actor, CLUTTER_EASE_OUT_QUAD, 250, "x", ICON_SPACING + PAGE_X_OFFSET(pageindex + 1), "y", ICON_SPACING, NULL);
-        /* first, we need to get the pages that we have to manipulate */
-        gint page_count = g_list_length(sbpages);
-        gint last_index = pageindex;
-        for (i = pageindex; i < page_count; i++) {
-            GList *thepage = g_list_nth_data(sbpages, i);
-            if (g_list_length(thepage) < (device_info->home_screen_icon_columns*device_info->home_screen_icon_rows)) {
-                last_index = i;
-                break;
-            }
-        }
-        if ((gint)g_list_length(g_list_nth_data(sbpages, last_index)) >= MAX_PAGE_ITEMS) {
-            /* it's the last page that is full, so we need to add a new page */
-            debug_printf("last page is full, appending page\n");
-            sbpages = g_list_append(sbpages, NULL);
-            last_index++;
-        }
-        debug_printf("will alter pages %d to %d (%d pages)\n", pageindex, last_index, (last_index - pageindex) + 1);
-        /* now manipulate the lists in reverse order */
-        for (i = last_index; i >= pageindex; i--) {
-            GList *thepage = g_list_nth_data(sbpages, i);
-            sbpages = g_list_remove(sbpages, thepage);
-            GList *prevpage = NULL;
-            if (i > pageindex) {
-                prevpage = g_list_nth_data(sbpages, i-1);
-            }
-            gint thepage_count = g_list_length(thepage);
-            while (thepage_count >= MAX_PAGE_ITEMS) {
-                thepage = g_list_remove(thepage, g_list_nth_data(thepage, thepage_count-1));
-                thepage_count = g_list_length(thepage);
-            }
-            if (prevpage) {
-                SBItem *prev_page_item = g_list_nth_data(prevpage, MAX_PAGE_ITEMS-1);
-                /* animate this item to fix drawing error */
-                actor = clutter_actor_get_parent(prev_page_item->texture);
-                clutter_actor_animate(actor, CLUTTER_LINEAR, 100, "x", ICON_SPACING + PAGE_X_OFFSET(i + 1), "y", ICON_SPACING, NULL);
-                thepage = g_list_prepend(thepage, prev_page_item);
-            } else {
-                thepage = g_list_prepend(thepage, last_item);
-            }
-            sbpages = g_list_insert(sbpages, thepage, i);
-        }
+        gui_pages_reflow(pageindex);
     }
-    return g_list_insert(iconlist, newitem, newpos >= MAX_PAGE_ITEMS ? 15:newpos);
 }
 
 /* clock */
@@ -390,11 +525,57 @@ static void gui_spinner_stop()
     clutter_actor_hide(spinner);
 }
 
+static gfloat gui_animation_get_final(ClutterAnimation *animation, const gchar *property)
+{
+    ClutterInterval *interval = clutter_animation_get_interval(animation, property);
+    return g_value_get_float(clutter_interval_peek_final_value(interval));
+}
+
+/* moves icon to x, y; an icon already on its way there is left alone and a
+ * running transition gets the new target instead of a new animation */
+static void gui_icon_move(ClutterActor *icon, gfloat x, gfloat y, guint duration)
+{
+    ClutterAnimation *animation = clutter_actor_get_animation(icon);
+
+    if (animation && (!clutter_animation_has_property(animation, "x") || !clutter_animation_has_property(animation, "y"))) {
+        animation = NULL;
+    }
+
+    if (duration == 0) {
+        /* keep a running transition from moving it away again */
+        if (animation) {
+            clutter_animation_update_interval(animation, "x", clutter_interval_new(G_TYPE_FLOAT, x, x));
+            clutter_animation_update_interval(animation, "y", clutter_interval_new(G_TYPE_FLOAT, y, y));
+        }
+        clutter_actor_set_position(icon, x, y);
+        return;
+    }
+
+    if (animation) {
+        if ((gui_animation_get_final(animation, "x") == x) && (gui_animation_get_final(animation, "y") == y)) {
+            icon_anim_skipped++;
+            return;
+        }
+        clutter_animation_update_interval(animation, "x", clutter_interval_new(G_TYPE_FLOAT, clutter_actor_get_x(icon), x));
+        clutter_animation_update_interval(animation, "y", clutter_interval_new(G_TYPE_FLOAT, clutter_actor_get_y(icon), y));
+        clutter_timeline_rewind(clutter_animation_get_timeline(animation));
+        icon_anim_retargeted++;
+        return;
+    }
+
+    if ((clutter_actor_get_x(icon) == x) && (clutter_actor_get_y(icon) == y)) {
+        icon_anim_skipped++;
+        return;
+    }
+    clutter_actor_animate(icon, CLUTTER_EASE_OUT_QUAD, duration, "x", x, "y", y, NULL);
+    icon_anim_created++;
+}
+
 static void gui_dock_align_icons(gboolean animated)
 {
     if (!dockitems)
         return;
-    gint count = g_list_length(dockitems);
+    gint count = dockitems->count;
     if (count == 0) {
         return;
     }
@@ -410,7 +591,7 @@ static void gui_dock_align_icons(gboolean animated)
 
     /* set positions */
     for (i = 0; i < count; i++) {
-        SBItem *item = g_list_nth_data(dockitems, i);
+        SBItem *item = dockitems->items[i];
         if (!item || !item->texture) {
             continue;
         }
@@ -420,11 +601,7 @@ static void gui_dock_align_icons(gboolean animated)
         }
 
         if (item != selected_item) {
-            if (animated) {
-                clutter_actor_animate(icon, CLUTTER_EASE_OUT_QUAD, ICON_MOVEMENT_DURATION, "x", xpos, "y", ypos, NULL);
-            } else {
-                clutter_actor_set_position(icon, xpos, ypos);
-            }
+            gui_icon_move(icon, xpos, ypos, animated ? ICON_MOVEMENT_DURATION : 0);
         }
 
         xpos += device_info->home_screen_icon_width;
@@ -434,23 +611,174 @@ static void gui_dock_align_icons(gboolean animated)
     }
 }
 
-static void gui_page_align_icons(guint page_num, gboolean animated)
+static void gui_item_decode(SBItem *item, const char *icon_filename, guint priority);
+
+static const char *gui_item_get_icon_filename(SBItem *item)
+{
+    if (item->is_folder) {
+        return SBMGR_DATA "/folder.png";
+    }
+    return sbitem_get_icon_filename(item);
+}
+
+static gboolean gui_page_is_realized(gint page_num)
+{
+    if (ABS(page_num - current_page) <= 1) {
+        return TRUE;
+    }
+    /* the page we are sliding away from stays until it is out of sight */
+    return (page_slide_from >= 0) && (ABS(page_num - page_slide_from) <= 1);
+}
+
+/* whether the icon of item should be uploaded, only far pages do without */
+static gboolean gui_item_is_resident(SBItem *item)
+{
+    SBPage *page = item->page;
+
+    if (page && page->folder) {
+        return gui_item_is_resident(page->folder);
+    }
+    if (!page || (page->index < 0)) {
+        return TRUE;
+    }
+    return gui_page_is_realized(page->index) || g_queue_find(resident_pages, page);
+}
+
+static void gui_texture_clear(ClutterActor *texture)
+{
+    static const guchar empty[4] = { 0, 0, 0, 0 };
+
+    g_object_set_data(G_OBJECT(texture), "atlas-entry", NULL);
+    clutter_texture_set_from_rgb_data(CLUTTER_TEXTURE(texture), empty, TRUE, 1, 1, 4, 4,
+                                      CLUTTER_TEXTURE_RGB_FLAG_PREMULT, NULL);
+}
+
+/* gives the icon textures back, the actor keeps its size; the items of
+ * a folder go with it */
+static void gui_item_evict_texture(SBItem *item)
 {
-    if (!sbpages)
+    guint i;
+
+    if (!item->texture || item->texture_evicted || (item == selected_item)) {
         return;
+    }
+    gui_texture_clear(item->texture);
+    if (item->mini_texture) {
+        gui_texture_clear(item->mini_texture);
+    }
+    item->texture_evicted = TRUE;
+
+    for (i = 0; item->is_folder && (i < item->subitems->count); i++) {
+        gui_item_evict_texture(item->subitems->items[i]);
+    }
+}
+
+static void gui_item_reload_texture(SBItem *item)
+{
+    guint i;
+
+    if (item->texture && item->texture_evicted) {
+        item->texture_evicted = FALSE;
+        /* ahead of everything still waiting to be decoded */
+        gui_item_decode(item, gui_item_get_icon_filename(item), 0);
+        page_reloads++;
+    }
+    for (i = 0; item->is_folder && (i < item->subitems->count); i++) {
+        gui_item_reload_texture(item->subitems->items[i]);
+    }
+}
+
+/* marks page as most recently used and brings evicted icons back */
+static void gui_page_touch(SBPage *page)
+{
+    guint i;
+
+    if (g_queue_peek_head(resident_pages) != page) {
+        g_queue_remove(resident_pages, page);
+        g_queue_push_head(resident_pages, page);
+    }
+    for (i = 0; i < page->count; i++) {
+        if (page->items[i]) {
+            gui_item_reload_texture(page->items[i]);
+        }
+    }
+}
+
+static void gui_pages_evict()
+{
+    while (g_queue_get_length(resident_pages) > PAGE_RESIDENT_MAX) {
+        SBPage *page = g_queue_peek_tail(resident_pages);
+        guint i;
+        if (gui_page_is_realized(page->index)) {
+            break;
+        }
+        g_queue_pop_tail(resident_pages);
+        for (i = 0; i < page->count; i++) {
+            if (page->items[i]) {
+                gui_item_evict_texture(page->items[i]);
+            }
+        }
+        page_evictions++;
+        debug_printf("%s: evicted page %d (%d evictions, %d reloads)\n", __func__, page->index, page_evictions, page_reloads);
+    }
+}
+
+/* shows or hides the actors of a page depending on its distance */
+static void gui_page_update_realized(SBPage *page)
+{
+    gboolean realized = gui_page_is_realized(page->index);
+    guint i;
+
+    for (i = 0; i < page->count; i++) {
+        SBItem *item = page->items[i];
+        if (!item || !item->drawn || !item->texture || (item == selected_item)) {
+            continue;
+        }
+        ClutterActor *icon = clutter_actor_get_parent(item->texture);
+        if (!icon) {
+            continue;
+        }
+        if (realized) {
+            clutter_actor_show(icon);
+        } else {
+            clutter_actor_hide(icon);
+        }
+    }
+    if (realized) {
+        gui_page_touch(page);
+    }
+}
+
+static void gui_pages_update_realized()
+{
+    guint i;
 
-    if (g_list_length(sbpages) == 0) {
+    for (i = 0; i < sbpages->len; i++) {
+        gui_page_update_realized(gui_get_page(i));
+    }
+    gui_pages_evict();
+}
+
+static void gui_page_slide_completed_cb(ClutterAnimation *animation, gpointer user_data)
+{
+    page_slide_from = -1;
+    gui_pages_update_realized();
+}
+
+static void gui_page_align_icons(guint page_num, gboolean animated)
+{
+    if (sbpages->len == 0) {
         printf("%s: no pages? that's strange...\n", __func__);
         return;
     }
 
-    GList *pageitems = g_list_nth_data(sbpages, page_num);
-    if (!pageitems) {
+    SBPage *pageitems = gui_get_page(page_num);
+    if (!pageitems || (pageitems->count == 0)) {
         printf("%s: no items on page %d\n", __func__, page_num);
         return;
     }
 
-    gint count = g_list_length(pageitems);
+    gint count = pageitems->count;
 
     gfloat ypos = ICON_SPACING;
     gfloat xpos = ICON_SPACING + PAGE_X_OFFSET(page_num);
@@ -460,7 +788,7 @@ static void gui_page_align_icons(guint page_num, gboolean animated)
 
     /* set positions */
     for (i = 0; i < count; i++) {
-        SBItem *item = g_list_nth_data(pageitems, i);
+        SBItem *item = pageitems->items[i];
         if (!item) {
             debug_printf("%s: item is null for i=%d\n", __func__, i);
             continue;
@@ -475,11 +803,7 @@ static void gui_page_align_icons(guint page_num, gboolean animated)
         }
 
         if (item != selected_item) {
-            if (animated) {
-                clutter_actor_animate(icon, CLUTTER_EASE_OUT_QUAD, ICON_MOVEMENT_DURATION, "x", xpos, "y", ypos, NULL);
-            } else {
-                clutter_actor_set_position(icon, xpos, ypos);
-            }
+            gui_icon_move(icon, xpos, ypos, animated ? ICON_MOVEMENT_DURATION : 0);
         }
 
         if (((i + 1) % device_info->home_screen_icon_columns) == 0) {
@@ -491,6 +815,9 @@ static void gui_page_align_icons(guint page_num, gboolean animated)
             xpos += device_info->home_screen_icon_width + (stage_area.x2 - (ICON_SPACING*2) - (device_info->home_screen_icon_columns*device_info->home_screen_icon_width)) / (device_info->home_screen_icon_columns-1);
         }
     }
+
+    /* items might have been moved here from a page out of sight */
+    gui_page_update_realized(pageitems);
 }
 
 static void gui_page_indicator_group_align()
@@ -519,7 +846,7 @@ static void gui_page_indicator_group_align()
 
 static gboolean page_indicator_clicked_cb(ClutterActor *actor, ClutterButtonEvent *event, gpointer data);
 
-static void gui_page_indicator_group_add(GList *page, int page_index)
+static void gui_page_indicator_group_add(SBPage *page, int page_index)
 {
     debug_printf("%s: adding page indicator for page %d\n", __func__, page_index);
     if (page_indicator) {
@@ -534,7 +861,7 @@ static void gui_page_indicator_group_add(GList *page, int page_index)
     }
 }
 
-static void gui_page_indicator_group_remove(GList *page, int page_index)
+static void gui_page_indicator_group_remove(SBPage *page, int page_index)
 {
     debug_printf("%s: removing page indicator for page %d\n", __func__, page_index);
     if (page_indicator) {
@@ -547,19 +874,23 @@ static void gui_page_indicator_group_remove(GList *page, int page_index)
 
 static void gui_pages_remove_empty()
 {
-    gint count = g_list_length(sbpages);
-    gint i;
-    GList *page = NULL;
+    guint i = 0;
+    SBPage *page = NULL;
 
-    for (i = 0; i < count; i++) {
-        page = g_list_nth_data(sbpages, i);
-        debug_printf("%s: checking page %d itemcount %d\n", __func__, i, g_list_length(page));
-        if (g_list_length(page) == 0) {
+    while (i < sbpages->len) {
+        page = gui_get_page(i);
+        debug_printf("%s: checking page %d itemcount %d\n", __func__, i, page->count);
+        if (page->count == 0) {
             debug_printf("%s: removing page %d\n", __func__, i);
             gui_page_indicator_group_remove(page, i);
+            g_queue_remove(resident_pages, page);
+            g_ptr_array_remove_index(sbpages, i);
+            sbpage_free(page, FALSE);
+        } else {
+            page->index = i;
+            i++;
         }
     }
-    sbpages = g_list_remove_all(sbpages, NULL);
 }
 
 static void gui_set_current_page(int pageindex, gboolean animated)
@@ -569,15 +900,18 @@ static void gui_set_current_page(int pageindex, gboolean animated)
     if ((pageindex < 0) || (pageindex >= count))
         return;
 
+    page_slide_from = animated ? current_page : -1;
+    current_page = pageindex;
+
     /* make sure the page has correct aligned icons */
     gui_page_align_icons(pageindex, FALSE);
-
-    current_page = pageindex;
+    gui_pages_update_realized();
 
     gui_page_indicator_group_align();
 
     if (animated) {
-        clutter_actor_animate(the_sb, CLUTTER_EASE_IN_OUT_CUBIC, 400, "x", (gfloat) (-PAGE_X_OFFSET(current_page)), NULL);
+        ClutterAnimation *animation = clutter_actor_animate(the_sb, CLUTTER_EASE_IN_OUT_CUBIC, 400, "x", (gfloat) (-PAGE_X_OFFSET(current_page)), NULL);
+        g_signal_connect(animation, "completed", G_CALLBACK(gui_page_slide_completed_cb), NULL);
     } else {
         clutter_actor_set_x(the_sb, (gfloat)(-PAGE_X_OFFSET(current_page)));
     }
@@ -593,141 +927,212 @@ static void gui_show_previous_page()
     gui_set_current_page(current_page-1, TRUE);
 }
 
-static plist_t sbitem_get_subitems(SBItem *item)
+static void gui_get_limits(SBIconStateLimits *limits)
 {
-    plist_t result = plist_new_array();
-    if (item && item->subitems) {
-        guint i;
-        for (i = 0; i < g_list_length(item->subitems); i++) {
-            SBItem *subitem = g_list_nth_data(item->subitems, i);
-            plist_t node = plist_dict_get_item(subitem->node, "displayIdentifier");
-            if (!node) {
-                printf("could not get displayIdentifier\n");
-                continue;
-            }
-            plist_array_append_item(result, plist_copy(node));
-        }
-    }
-    return result;
+    limits->dock_items = device_info->home_screen_icon_dock_max_count;
+    limits->page_items = PAGE_ITEMS;
+    limits->folder_page_items = FOLDER_ITEMS;
+    limits->folder_pages = device_info->icon_folder_max_pages;
 }
 
-static plist_t sbitem_to_plist(SBItem *item)
+/* puts all items where they belong after the layout was rearranged */
+static void gui_layout_refresh()
 {
-    plist_t result = plist_new_dict();
-    if (!item) {
-        return result;
-    }
-    plist_t node;
-    if (item->is_folder) {
-        node = plist_dict_get_item(item->node, "displayName");
-        if (!node) {
-            printf("could not get displayName for folder!\n");
-            return result;
-        }
-        plist_dict_insert_item(result, "displayName", plist_copy(node));
-        plist_t iconlists = plist_new_array();
-        plist_array_append_item(iconlists, sbitem_get_subitems(item));
-        plist_dict_insert_item(result, "iconLists", iconlists);
-    } else {
-        node = plist_dict_get_item(item->node, "displayIdentifier");
-        if (!node) {
-            printf("could not get displayIdentifier\n");
-            return result;
+    guint i, j;
+
+    for (i = 0; i < dockitems->count; i++) {
+        gui_item_take_out_of_folder(dockitems->items[i]);
+        gui_item_move_to_dock(dockitems->items[i], TRUE);
+    }
+    clutter_group_remove_all(CLUTTER_GROUP(page_indicator_group));
+    for (i = 0; i < sbpages->len; i++) {
+        SBPage *page = gui_get_page(i);
+        for (j = 0; j < page->count; j++) {
+            gui_item_take_out_of_folder(page->items[j]);
+            gui_item_move_to_dock(page->items[j], FALSE);
         }
-        plist_dict_insert_item(result, "displayIdentifier", plist_copy(node));
+        gui_page_indicator_group_add(page, i);
+        gui_page_align_icons(i, TRUE);
+    }
+    gui_dock_align_icons(TRUE);
+    if (current_page >= (gint)sbpages->len) {
+        gui_set_current_page(sbpages->len - 1, FALSE);
     }
-    return result;
+    gui_history_record();
 }
 
-plist_t gui_get_iconstate(const char *format_version)
+/**
+ * Moves items of the shown layout that exceed the limits of the device,
+ * which rejects such layouts. Nothing is changed while the limits are
+ * not known yet. Returns the number of items moved.
+ */
+guint gui_fit_to_device_limits()
 {
-    plist_t iconstate = NULL;
-    plist_t pdockarray = NULL;
-    plist_t pdockitems = NULL;
-    guint i;
+    SBIconState state = { dockitems, sbpages, num_dock_items, FOLDER_ITEMS };
+    SBIconStateLimits limits;
+    GList *l, *next;
+    guint moved, i, j;
 
-    int use_version = 1;
-    if (format_version && (strcmp(format_version, "2") == 0)) {
-        use_version = 2;
+    if (!device_limits_known) {
+        return 0;
     }
 
-    guint count = g_list_length(dockitems);
-    pdockitems = plist_new_array();
-    for (i = 0; i < count; i++) {
-        SBItem *item = g_list_nth_data(dockitems, i);
-        if (item && item->node) {
-            plist_array_append_item(pdockitems, sbitem_to_plist(item));
-        }
+    gui_get_limits(&limits);
+    if (iconstate_check(&state, &limits)) {
+        return 0;
     }
 
-    if (use_version == 1) {
-        for (i = count; i < num_dock_items; i++) {
-            plist_array_append_item(pdockitems, plist_new_bool(0));
+    moved = iconstate_normalize(&state, &limits);
+    debug_printf("%s: moved %d items to fit the device limits\n", __func__, moved);
+    num_dock_items = state.dock_slots;
+
+    /* empty pages were freed */
+    for (l = resident_pages->head; l; l = next) {
+        next = l->next;
+        for (i = 0; (i < sbpages->len) && (gui_get_page(i) != l->data); i++);
+        if (i == sbpages->len) {
+            g_queue_delete_link(resident_pages, l);
         }
     }
-    pdockarray = plist_new_array();
-    plist_array_append_item(pdockarray, pdockitems);
 
-    iconstate = plist_new_array();
-    plist_array_append_item(iconstate, pdockarray);
+    gui_layout_refresh();
 
-    for (i = 0; i < g_list_length(sbpages); i++) {
-        GList *page = g_list_nth_data(sbpages, i);
-        if (page) {
-            guint j;
-            count = g_list_length(page);
-            if (count <= 0) {
-                continue;
-            }
-            plist_t ppage = plist_new_array();
-            plist_t row = NULL;
-            if (use_version == 2) {
-                row = plist_new_array();
-                plist_array_append_item(ppage, row);
-            }
-            for (j = 0; j < (device_info->home_screen_icon_columns*device_info->home_screen_icon_rows); j++) {
-                SBItem *item = g_list_nth_data(page, j);
-                if (use_version == 1) {
-                    if ((j % device_info->home_screen_icon_columns) == 0) {
-                        row = plist_new_array();
-                        plist_array_append_item(ppage, row);
-                    }
-                }
-                if (item && item->node) {
-                    plist_array_append_item(row, sbitem_to_plist(item));
-                } else {
-                    if (use_version == 1)
-                        plist_array_append_item(row, plist_new_bool(0));
-                }
+    /* the folders that gave up items show fewer previews now */
+    for (i = 0; i < dockitems->count; i++) {
+        if (dockitems->items[i]->is_folder) {
+            gui_folder_redraw_subitems(dockitems->items[i]);
+        }
+    }
+    for (i = 0; i < sbpages->len; i++) {
+        SBPage *page = gui_get_page(i);
+        for (j = 0; j < page->count; j++) {
+            if (page->items[j]->is_folder) {
+                gui_folder_redraw_subitems(page->items[j]);
             }
-            plist_array_append_item(iconstate, plist_copy(ppage));
-            plist_free(ppage);
         }
     }
+    if (selected_folder) {
+        gui_folder_align_icons(selected_folder, FALSE);
+    }
 
-    return iconstate;
+    return moved;
 }
 
-/* input */
-static gboolean stage_motion_cb(ClutterActor *actor, ClutterMotionEvent *event, gpointer user_data)
+/**
+ * Builds the iconState tree of the shown layout, as the device takes it.
+ * Returns NULL if the layout does not fit the pages of the device.
+ */
+plist_t gui_get_iconstate(const char *format_version)
 {
-    /* check if an item has been raised */
-    if (!selected_item) {
-        return FALSE;
+    SBIconState state = { dockitems, sbpages, num_dock_items, FOLDER_ITEMS };
+    guint columns = device_info->home_screen_icon_columns;
+    guint rows = device_info->home_screen_icon_rows;
+
+    if (!iconstate_fits_grid(&state, columns, rows)) {
+        fprintf(stderr, "ERROR: %s: the layout does not fit the pages of the device\n", __func__);
+        return NULL;
     }
+    return iconstate_to_plist(&state, format_version, columns, rows);
+}
 
-    ClutterActor *icon = clutter_actor_get_parent(selected_item->texture);
+/**
+ * Serializes the shown layout into a binary plist dict holding
+ * formatVersion and iconState. The buffer is reused by the next call.
+ */
+const GByteArray *gui_get_iconstate_data(const char *format_version)
+{
+    SBIconState state = { dockitems, sbpages, num_dock_items, FOLDER_ITEMS };
 
-    clutter_actor_move_by(icon, (event->x - start_x), (event->y - start_y));
+    if (!iconstate_writer) {
+        iconstate_writer = plistwriter_new();
+    }
+    if (!iconstate_write_bin(&state, format_version, device_info->home_screen_icon_columns, device_info->home_screen_icon_rows, TRUE, iconstate_writer)) {
+        fprintf(stderr, "ERROR: %s: the layout does not fit the pages of the device\n", __func__);
+        return NULL;
+    }
+    return iconstate_writer->data;
+}
 
-    if (event->x-start_x > 0) {
-        move_left = FALSE;
-    } else {
-        move_left = TRUE;
+gboolean gui_iconstate_changed(plist_t iconstate, const char *format_version)
+{
+    SBIconState shown = { dockitems, sbpages, num_dock_items, FOLDER_ITEMS };
+    SBIconState state = { NULL, NULL, 0, 0 };
+    gboolean res = FALSE;
+
+    if (iconstate_parse(iconstate, format_version, &state, NULL)) {
+        res = !iconstate_equal(&shown, &state);
     }
+    iconstate_clear(&state);
+    debug_printf("%s: %s\n", __func__, res ? "changed" : "no change!");
 
-    start_x = event->x;
-    start_y = event->y;
+    return res;
+}
+
+/* the slot of grid at x, y; a pointer outside maps to the nearest slot */
+static gint slot_grid_lookup(const SlotGrid *grid, gfloat x, gfloat y)
+{
+    gint col = (gint)((x - grid->x) / grid->col_width);
+    gint row = (gint)((y - grid->y) / grid->row_height);
+
+    col = CLAMP(col, 0, grid->columns - 1);
+    row = CLAMP(row, 0, grid->rows - 1);
+
+    return row * grid->columns + col;
+}
+
+/* stage coordinates of the slots, matching the align functions */
+static void gui_drop_grids_update()
+{
+    gint columns = device_info->home_screen_icon_columns;
+    gfloat icon_width = device_info->home_screen_icon_width;
+    gfloat pitch = icon_width + (stage_area.x2 - (ICON_SPACING*2) - (columns*icon_width)) / (columns-1);
+
+    page_grid.x = sb_area.x1 + ICON_SPACING - (pitch - icon_width) / 2;
+    page_grid.y = sb_area.y1 + ICON_SPACING / 2;
+    page_grid.col_width = pitch;
+    page_grid.row_height = PAGE_ROW_HEIGHT;
+    page_grid.columns = columns;
+    page_grid.rows = device_info->home_screen_icon_rows;
+
+    /* the dock is centered, with room for the dragged item */
+    gint count = dockitems ? dockitems->count : 0;
+    if (!selected_item || !dockitems || (sbpage_index_of(dockitems, selected_item) < 0)) {
+        count++;
+    }
+    gfloat spacing = (count > columns) ? 3.0 : ICON_SPACING;
+    gfloat totalwidth = count * icon_width + spacing * (count - 1);
+    dock_grid.x = dock_area.x1 + (stage_area.x2 - totalwidth) / 2.0 - spacing / 2;
+    dock_grid.y = dock_area.y1;
+    dock_grid.col_width = icon_width + spacing;
+    dock_grid.row_height = DOCK_HEIGHT;
+    dock_grid.columns = count;
+    dock_grid.rows = 1;
+
+    /* relative to the open folder, before it is moved upwards */
+    columns = device_info->icon_folder_columns;
+    folder_grid.x = ICON_SPACING / 2;
+    folder_grid.y = split_pos + 8.0 + ICON_SPACING + ICON_SPACING;
+    folder_grid.col_width = ICON_COLUMN_WIDTH(columns);
+    folder_grid.row_height = ICON_ROW_HEIGHT;
+    folder_grid.columns = columns;
+    folder_grid.rows = device_info->icon_folder_rows;
+}
+
+static void gui_drop_target_reset()
+{
+    drop_list = NULL;
+    drop_slot = -1;
+    gui_drop_grids_update();
+}
+
+/* moves the dragged item to the slot under it, TRUE if the lists changed */
+static gboolean gui_drag_update_target()
+{
+    if (!selected_item) {
+        return FALSE;
+    }
+
+    ClutterActor *icon = clutter_actor_get_parent(selected_item->texture);
 
     gfloat center_x;
     gfloat center_y;
@@ -741,7 +1146,7 @@ static gboolean stage_motion_cb(ClutterActor *actor, ClutterMotionEvent *event,
             }
         }
     } else if (!selected_folder && clutter_actor_box_contains(&right_trigger, center_x + (device_info->home_screen_icon_width / 2), center_y)) {
-        if (current_page < (gint)(g_list_length(sbpages)-1)) {
+        if (current_page < (gint)sbpages->len-1) {
             if (elapsed_ms(&last_page_switch, 1000)) {
                 gui_show_next_page();
                 gettimeofday(&last_page_switch, NULL);
@@ -749,51 +1154,61 @@ static gboolean stage_motion_cb(ClutterActor *actor, ClutterMotionEvent *event,
         }
     }
 
+    /* the lists are only touched when the slot under the icon changes */
+    gint slot;
     if (selected_folder) {
-        selected_folder->subitems = g_list_remove(selected_folder->subitems, selected_item);
-        selected_folder->subitems =
-            iconlist_insert_item_at(selected_folder->subitems, selected_item, (center_x - 0.0), (center_y - split_pos - clutter_actor_get_y(aniupper)), 0, 4);
+        slot = folder_page * FOLDER_ITEMS + slot_grid_lookup(&folder_grid, center_x, center_y - clutter_actor_get_y(aniupper));
+        if ((drop_list == selected_folder->subitems) && (drop_slot == slot)) {
+            return FALSE;
+        }
+        sbpage_remove_item(selected_folder->subitems, selected_item);
+        sbpage_insert_item(selected_folder->subitems, selected_item, MIN((guint)slot, selected_folder->subitems->count));
+        drop_list = selected_folder->subitems;
+        drop_slot = slot;
         gui_folder_align_icons(selected_folder, TRUE);
     } else if (selected_item->is_dock_item) {
-        dockitems = g_list_remove(dockitems, selected_item);
         if (center_y >= dock_area.y1) {
+            slot = slot_grid_lookup(&dock_grid, center_x, center_y);
+            if ((drop_list == dockitems) && (drop_slot == slot)) {
+                return FALSE;
+            }
             debug_printf("%s: icon from dock moving inside the dock!\n", __func__);
-            selected_item->is_dock_item = TRUE;
-            dockitems =
-                iconlist_insert_item_at(dockitems, selected_item, (center_x - dock_area.x1), (center_y - dock_area.y1), 0, num_dock_items);
+            sbpage_remove_item(dockitems, selected_item);
+            iconlist_insert_item_at(dockitems, selected_item, slot, -1);
+            drop_list = dockitems;
+            drop_slot = slot;
             gui_dock_align_icons(TRUE);
         } else {
             debug_printf("%s: icon from dock moving outside the dock!\n", __func__);
+            sbpage_remove_item(dockitems, selected_item);
             selected_item->is_dock_item = FALSE;
+            gui_drop_target_reset();
             gui_page_align_icons(current_page, TRUE);
         }
     } else {
         int p = current_page;
-        int i;
-        GList *pageitems = NULL;
-        debug_printf("%s: current_page %d\n", __func__, p);
-        /* remove selected_item from all pages */
-        int count = g_list_length(sbpages);
-        for (i = 0; i < count; i++) {
-            pageitems = g_list_nth_data(sbpages, i);
-            sbpages = g_list_remove(sbpages, pageitems);
-            pageitems = g_list_remove(pageitems, selected_item);
-            sbpages = g_list_insert(sbpages, pageitems, i);
-        }
-        /* get current page */
-        pageitems = g_list_nth_data(sbpages, p);
-        /* remove current page from pages list as we will alter it */
-        sbpages = g_list_remove(sbpages, pageitems);
-        if (center_y >= dock_area.y1 && (g_list_length(dockitems) < num_dock_items)) {
+        SBPage *pageitems = gui_get_page(p);
+        if (center_y >= dock_area.y1 && (dockitems->count < (guint)num_dock_items)) {
             debug_printf("%s: regular icon is moving inside the dock!\n", __func__);
+            if (selected_item->page && (selected_item->page->index >= 0)) {
+                sbpage_remove_item(selected_item->page, selected_item);
+            }
             selected_item->is_dock_item = TRUE;
+            gui_drop_target_reset();
         } else {
-            debug_printf("%s: regular icon is moving!\n", __func__);
-            pageitems =
-                iconlist_insert_item_at(pageitems, selected_item, (center_x - sb_area.x1) + PAGE_X_OFFSET(p), (center_y - sb_area.y1), p, 4);
+            slot = slot_grid_lookup(&page_grid, center_x, center_y);
+            if ((drop_list == pageitems) && (drop_slot == slot)) {
+                return FALSE;
+            }
+            debug_printf("%s: regular icon is moving to slot %d of page %d\n", __func__, slot, p);
+            /* remove selected_item from the page it is on */
+            if (selected_item->page && (selected_item->page->index >= 0)) {
+                sbpage_remove_item(selected_item->page, selected_item);
+            }
+            iconlist_insert_item_at(pageitems, selected_item, slot, p);
+            drop_list = pageitems;
+            drop_slot = slot;
         }
-        /* insert back current page */
-        sbpages = g_list_insert(sbpages, pageitems, p);
         gui_dock_align_icons(TRUE);
         gui_page_align_icons(p, TRUE);
     }
@@ -801,54 +1216,84 @@ static gboolean stage_motion_cb(ClutterActor *actor, ClutterMotionEvent *event,
     return TRUE;
 }
 
-static gboolean page_indicator_clicked_cb(ClutterActor *actor, ClutterButtonEvent *event, gpointer data)
+static gboolean gui_drag_update_cb(gpointer user_data)
 {
-    if (event->click_count > 1) {
-        return FALSE;
+    drag_update_id = 0;
+    if (gui_drag_update_target()) {
+        drag_reflows++;
     }
-    const gchar *index_str = clutter_actor_get_name(actor);
-    int pageindex = strtol(index_str, NULL, 10);
-    debug_printf("page indicator for page %d has been clicked\n", pageindex);
-    gui_set_current_page(pageindex, TRUE);
-    return TRUE;
+    return FALSE;
 }
 
-static void gui_folder_redraw_subitems(SBItem *item)
+/* applies a pending update before the item is dropped */
+static void gui_drag_finish()
 {
-    if (!item)
-        return;
+    if (drag_update_id) {
+        clutter_threads_remove_repaint_func(drag_update_id);
+        gui_drag_update_cb(NULL);
+    }
+    if (drag_motion_events > 0) {
+        debug_printf("%s: %d motion events, %d reflows\n", __func__, drag_motion_events, drag_reflows);
+        debug_printf("%s: icon animations %d created, %d retargeted, %d skipped\n", __func__, icon_anim_created, icon_anim_retargeted, icon_anim_skipped);
+    }
+    drag_motion_events = 0;
+    drag_reflows = 0;
+    icon_anim_created = 0;
+    icon_anim_retargeted = 0;
+    icon_anim_skipped = 0;
+}
 
-    ClutterActor *minigrp = NULL;
-    ClutterActor *grp = clutter_actor_get_parent(item->texture);
-    guint cnt = clutter_group_get_n_children(CLUTTER_GROUP(grp));
-    guint i;
-    for (i = 0; i < cnt; i++) {
-        ClutterActor *act = clutter_group_get_nth_child(CLUTTER_GROUP(grp), i);
-        const char *nm = clutter_actor_get_name(act);
-        if (nm && !strcmp(nm, "mini")) {
-            minigrp = act;
-	    break;
-        }
+static gboolean stage_motion_cb(ClutterActor *actor, ClutterMotionEvent *event, gpointer user_data)
+{
+    /* check if an item has been raised */
+    if (!selected_item) {
+        return FALSE;
+    }
+
+    ClutterActor *icon = clutter_actor_get_parent(selected_item->texture);
+
+    clutter_actor_move_by(icon, (event->x - start_x), (event->y - start_y));
+
+    start_x = event->x;
+    start_y = event->y;
+
+    drag_motion_events++;
+    if (!drag_update_id) {
+        drag_update_id = clutter_threads_add_repaint_func(gui_drag_update_cb, NULL, NULL);
     }
-    if (minigrp) {
-        clutter_actor_destroy(minigrp);
+
+    return TRUE;
+}
+
+static gboolean page_indicator_clicked_cb(ClutterActor *actor, ClutterButtonEvent *event, gpointer data)
+{
+    if (event->click_count > 1) {
+        return FALSE;
     }
+    const gchar *index_str = clutter_actor_get_name(actor);
+    int pageindex = strtol(index_str, NULL, 10);
+    debug_printf("page indicator for page %d has been clicked\n", pageindex);
+    gui_set_current_page(pageindex, TRUE);
+    return TRUE;
+}
+
+/* the folder icon paints previews of its first icons, from their reduced copies */
+static void gui_folder_redraw_subitems(SBItem *item)
+{
+    if (!item || !item->texture)
+        return;
+
+    SBIconActor *icon = SB_ICON_ACTOR(item->texture);
+    gfloat width = device_info->home_screen_icon_width * FOLDER_MINI_SCALE;
+    gfloat height = device_info->home_screen_icon_height * FOLDER_MINI_SCALE;
+    guint i;
 
-    minigrp = clutter_group_new();
-    clutter_actor_set_name(minigrp, "mini");
-    clutter_container_add_actor(CLUTTER_CONTAINER(grp), minigrp);
-    for (i = 0; i < g_list_length(item->subitems); i++) {
-        SBItem *subitem = (SBItem*)g_list_nth_data(item->subitems, i);
-        if (subitem && subitem->texture && subitem->node) {
-            ClutterActor *suba = clutter_clone_new(subitem->texture);
-            clutter_actor_unparent(suba);
-            clutter_container_add_actor(CLUTTER_CONTAINER(minigrp), suba);
-            clutter_actor_set_scale(suba, 0.22, 0.22);
-            clutter_actor_set_position(suba, 8.0 + (i%3)*ICON_SPACING, 8.0 + ((double)(int)((int)i/(int)3))*ICON_SPACING);
-            if (i < 9)
-                clutter_actor_show(suba);
-            else
-                clutter_actor_hide(suba);
+    sb_icon_actor_clear_minis(icon);
+    for (i = 0; i < item->subitems->count && i < 9; i++) {
+        SBItem *subitem = item->subitems->items[i];
+        if (subitem && subitem->texture) {
+            sb_icon_actor_add_mini(icon, subitem->mini_texture ? subitem->mini_texture : subitem->texture,
+                                   8.0 + (i%3)*ICON_SPACING, 8.0 + (i/3)*ICON_SPACING, width, height);
         }
     }
 }
@@ -858,15 +1303,14 @@ static void gui_folder_align_icons(SBItem *item, gboolean animated)
     if (!item || !item->subitems)
         return;
 
-    gint count = g_list_length(item->subitems);
-
-    gfloat ypos = 8.0 + ICON_SPACING + ICON_SPACING;
-    gfloat xpos = (ICON_SPACING / 2);
+    gint count = item->subitems->count;
+    gint columns = device_info->icon_folder_columns;
+    gint first = (item == selected_folder) ? folder_page * FOLDER_ITEMS : 0;
     gint i = 0;
 
-    /* set positions */
+    /* set positions, only the shown folder page is visible */
     for (i = 0; i < count; i++) {
-        SBItem *si = g_list_nth_data(item->subitems, i);
+        SBItem *si = item->subitems->items[i];
         if (!si) {
             debug_printf("%s: item is null for i=%d\n", __func__, i);
             continue;
@@ -880,54 +1324,132 @@ static void gui_folder_align_icons(SBItem *item, gboolean animated)
             continue;
         }
 
-        if (si != selected_item) {
-            if (animated) {
-                clutter_actor_animate(icon, CLUTTER_EASE_OUT_QUAD, 250, "x", xpos, "y", ypos, NULL);
-            } else {
-                clutter_actor_set_position(icon, xpos, ypos);
+        if ((i < first) || (i >= first + (gint)FOLDER_ITEMS)) {
+            if (si != selected_item) {
+                clutter_actor_hide(icon);
             }
+            continue;
+        }
+        if (item == selected_folder) {
+            clutter_actor_show(icon);
         }
 
-        if (((i + 1) % 4) == 0) {
-            xpos = ICON_SPACING;
-            ypos += 88.0;
-        } else {
-            xpos += 76.0;
+        gint slot = i - first;
+        gfloat xpos = ((slot < columns) ? (ICON_SPACING / 2) : ICON_SPACING) + (slot % columns) * ICON_COLUMN_WIDTH(columns);
+        gfloat ypos = 8.0 + ICON_SPACING + ICON_SPACING + (slot / columns) * ICON_ROW_HEIGHT;
+
+        if (si != selected_item) {
+            gui_icon_move(icon, xpos, ypos, animated ? 250 : 0);
+        }
+    }
+}
+
+/* number of pages of the folder */
+static guint gui_folder_get_page_count(SBItem *item)
+{
+    if (!item->subitems || (item->subitems->count == 0)) {
+        return 1;
+    }
+    return (item->subitems->count + FOLDER_ITEMS - 1) / FOLDER_ITEMS;
+}
+
+/* icons of later folder pages are only fetched once the page is shown */
+static void gui_folder_load_page(SBItem *item, guint page)
+{
+    guint i;
+    guint last = MIN((page + 1) * FOLDER_ITEMS, item->subitems->count);
+
+    for (i = page * FOLDER_ITEMS; i < last; i++) {
+        SBItem *si = item->subitems->items[i];
+        if (!si->texture_requested) {
+            gui_load_item_texture(si);
         }
     }
 }
 
+static void gui_folder_page_dots_update()
+{
+    gint count;
+    gint i;
+
+    if (!folder_page_dots) {
+        return;
+    }
+    count = clutter_group_get_n_children(CLUTTER_GROUP(folder_page_dots));
+    for (i = 0; i < count; i++) {
+        ClutterActor *dot = clutter_group_get_nth_child(CLUTTER_GROUP(folder_page_dots), i);
+        clutter_actor_set_opacity(dot, (i == (gint)folder_page) ? 200 : 100);
+    }
+}
+
+static void gui_folder_show_page(SBItem *item, gint page);
+
+static gboolean folder_page_dot_clicked_cb(ClutterActor *actor, ClutterButtonEvent *event, gpointer data)
+{
+    if (event->click_count > 1) {
+        return FALSE;
+    }
+    gui_folder_show_page(selected_folder, GPOINTER_TO_INT(data));
+    return TRUE;
+}
+
+/* one dot per folder page, centered at y in the folder */
+static void gui_folder_page_dots_add(SBItem *item, gfloat y)
+{
+    guint count = gui_folder_get_page_count(item);
+    gfloat xpos = 0.0;
+    guint i;
+
+    folder_page_dots = clutter_group_new();
+    clutter_container_add_actor(CLUTTER_CONTAINER(folder), folder_page_dots);
+    for (i = 0; i < count; i++) {
+        ClutterActor *dot = clutter_clone_new(page_indicator);
+        clutter_actor_unparent(dot);
+        clutter_actor_set_reactive(dot, TRUE);
+        g_signal_connect(dot, "button-press-event", G_CALLBACK(folder_page_dot_clicked_cb), GINT_TO_POINTER(i));
+        clutter_container_add_actor(CLUTTER_CONTAINER(folder_page_dots), dot);
+        clutter_actor_set_position(dot, xpos, 0.0);
+        xpos += clutter_actor_get_width(dot);
+    }
+    clutter_actor_set_position(folder_page_dots, (stage_area.x2 - xpos) / 2.0, y);
+    clutter_actor_show(folder_page_dots);
+    gui_folder_page_dots_update();
+}
+
+static void gui_folder_show_page(SBItem *item, gint page)
+{
+    if (!item || (page < 0) || (page >= (gint)gui_folder_get_page_count(item)) || (page == (gint)folder_page)) {
+        return;
+    }
+    folder_page = page;
+    gui_folder_load_page(item, folder_page);
+    gui_folder_align_icons(item, FALSE);
+    gui_folder_page_dots_update();
+}
+
 static gboolean folderview_close_finish(gpointer user_data)
 {
     SBItem *item = (SBItem*)user_data;
 
     ClutterActor *label = clutter_group_get_nth_child(CLUTTER_GROUP(folder), 2);
 
-    const gchar *oldname = clutter_text_get_text(CLUTTER_TEXT(item->label));
+    const gchar *oldname = sbitem_get_display_name(item);
     const gchar *newname = clutter_text_get_text(CLUTTER_TEXT(label));
     if (g_str_equal(oldname, newname) == FALSE) {
-        gfloat oldwidth = clutter_actor_get_width(item->label);
-        clutter_text_set_text(CLUTTER_TEXT(item->label), newname);
-        plist_dict_remove_item(item->node, "displayName");
-        plist_dict_insert_item(item->node, "displayName", plist_new_string(newname));
-        gfloat newwidth = clutter_actor_get_width(item->label);
-        gfloat xshift = -(newwidth-oldwidth)/2;
-        clutter_actor_move_by(item->label, xshift, 0);
-        if (item->label_shadow) {
-            clutter_text_set_text(CLUTTER_TEXT(item->label_shadow), newname);
-            clutter_actor_move_by(item->label_shadow, xshift, 0);
-        }
-    }
-    clutter_actor_show(item->label);
-    if (item->label_shadow) {
-        clutter_actor_show(item->label_shadow);
+        gui_item_set_label(item, label_cache_set_text(label_cache, item->label, newname));
+        sbitem_set_display_name(item, newname);
     }
+    sb_icon_actor_set_label_visible(SB_ICON_ACTOR(item->texture), TRUE);
+    sb_icon_actor_set_shadow_visible(SB_ICON_ACTOR(item->texture), TRUE);
 
     ClutterActor *newparent = clutter_actor_get_parent(item->texture);
-    GList *subitems = item->subitems;
+    SBPage *subitems = item->subitems;
     guint i;
-    for (i = 0; i < g_list_length(subitems); i++) {
-        SBItem *si = g_list_nth_data(subitems, i);
+    for (i = 0; i < subitems->count; i++) {
+        SBItem *si = subitems->items[i];
+        if (!si->texture) {
+            continue;
+        }
         ClutterActor *actor = clutter_actor_get_parent(si->texture);
         clutter_actor_reparent(actor, newparent);
         clutter_actor_hide(actor);
@@ -937,6 +1459,7 @@ static gboolean folderview_close_finish(gpointer user_data)
 
     clutter_actor_destroy(folder);
     folder = NULL;
+    folder_page_dots = NULL;
     clutter_actor_destroy(aniupper);
     aniupper = NULL;
     clutter_actor_destroy(anilower);
@@ -944,16 +1467,16 @@ static gboolean folderview_close_finish(gpointer user_data)
     split_pos = 0.0;
 
     /* un-dim sb and dock items */
-    GList *page = g_list_nth_data(sbpages, current_page);
+    SBPage *page = gui_get_page(current_page);
     SBItem *it;
     ClutterActor *act;
-    for (i = 0; i < g_list_length(page); i++) {
-        it = g_list_nth_data(page, i);
+    for (i = 0; page && i < page->count; i++) {
+        it = page->items[i];
         act = clutter_actor_get_parent(it->texture);
         clutter_actor_set_opacity(act, 255);
     }
-    for (i = 0; i < g_list_length(dockitems); i++) {
-        it = g_list_nth_data(dockitems, i);
+    for (i = 0; dockitems && i < dockitems->count; i++) {
+        it = dockitems->items[i];
         act = clutter_actor_get_parent(it->texture);
         clutter_actor_set_opacity(act, 255);
     }
@@ -1011,9 +1534,60 @@ static gboolean folderview_open_finish(gpointer user_data)
     return FALSE;
 }
 
+static gint64 gui_get_time()
+{
+    GTimeVal tv;
+    g_get_current_time(&tv);
+    return (gint64)tv.tv_sec * G_USEC_PER_SEC + tv.tv_usec;
+}
+
+/* the visible stage contents between y and y + height, painted from
+ * clones of the live actors so nothing has to be read back */
+static ClutterActor *gui_stage_clone_new(gfloat y, gfloat height)
+{
+    ClutterActor *grp = clutter_group_new();
+    GList *children = clutter_container_get_children(CLUTTER_CONTAINER(stage));
+    GList *l;
+
+    /* the stage background is not part of any clone, and the halves have
+     * to cover the actors below them */
+    ClutterActor *bg = clutter_rectangle_new_with_color(&stage_color);
+    clutter_actor_set_position(bg, 0.0, 0.0);
+    clutter_actor_set_size(bg, (gfloat)(stage_area.x2), (gfloat)(stage_area.y2));
+    clutter_container_add_actor(CLUTTER_CONTAINER(grp), bg);
+
+    for (l = children; l; l = l->next) {
+        ClutterActor *child = CLUTTER_ACTOR(l->data);
+        gfloat cx, cy, cw, ch;
+        if (!CLUTTER_ACTOR_IS_VISIBLE(child)) {
+            continue;
+        }
+        ClutterActor *clone = clutter_clone_new(child);
+        clutter_actor_get_position(child, &cx, &cy);
+        clutter_actor_get_size(child, &cw, &ch);
+        clutter_actor_set_position(clone, cx, cy);
+        clutter_actor_set_size(clone, cw, ch);
+        clutter_container_add_actor(CLUTTER_CONTAINER(grp), clone);
+    }
+    g_list_free(children);
+
+    clutter_actor_set_clip(grp, 0.0, y, (gfloat)(stage_area.x2), height);
+    return grp;
+}
+
+static gint64 folder_open_start = 0;
+static gulong folder_open_paint_id = 0;
+
+static void gui_folder_open_painted_cb(ClutterActor *actor, gpointer user_data)
+{
+    debug_printf("%s: first frame of the folder animation after %d us\n", __func__, (int)(gui_get_time() - folder_open_start));
+    g_signal_handler_disconnect(stage, folder_open_paint_id);
+    folder_open_paint_id = 0;
+}
+
 static void folderview_open(SBItem *item)
 {
-    GList *page = g_list_nth_data(sbpages, current_page);
+    SBPage *page = gui_get_page(current_page);
     guint i;
     SBItem *it;
     ClutterActor *act;
@@ -1023,47 +1597,43 @@ static void folderview_open(SBItem *item)
     gboolean is_dock_folder = FALSE;
 
     selected_folder = item;
+    folder_page = 0;
 
-    ClutterActor *fldr = NULL;
+    folder_open_start = gui_get_time();
+    if (!folder_open_paint_id) {
+        folder_open_paint_id = g_signal_connect_after(stage, "paint", G_CALLBACK(gui_folder_open_painted_cb), NULL);
+    }
 
     /* dim the springboard icons */
-    for (i = 0; i < g_list_length(page); i++) {
-        it = g_list_nth_data(page, i);
+    for (i = 0; page && i < page->count; i++) {
+        it = page->items[i];
         act = clutter_actor_get_parent(it->texture);
         if (item == it) {
             clutter_actor_set_opacity(act, 255);
-            ypos = 24.0+(gfloat)((int)(i / 4)+1) * 88.0;
-            xpos = 16 + ((i % 4))*76.0;
-            clutter_actor_hide(it->label);
-            if (it->label_shadow) {
-                clutter_actor_hide(it->label_shadow);
-            }
-            fldr = act;
+            ypos = 24.0+(gfloat)((int)(i / device_info->home_screen_icon_columns)+1) * ICON_ROW_HEIGHT;
+            xpos = 16 + ((i % device_info->home_screen_icon_columns))*ICON_COLUMN_WIDTH(device_info->home_screen_icon_columns);
+            sb_icon_actor_set_label_visible(SB_ICON_ACTOR(it->texture), FALSE);
         } else {
             clutter_actor_set_opacity(act, 64);
         }
     }
 
     /* dim the dock icons */
-    guint count = g_list_length(dockitems);
+    guint count = dockitems ? dockitems->count : 0;
     for (i = 0; i < count; i++) {
-        it = g_list_nth_data(dockitems, i);
+        it = dockitems->items[i];
         act = clutter_actor_get_parent(it->texture);
         if (item == it) {
             clutter_actor_set_opacity(act, 255);
 	    ypos = stage_area.y1 - DOCK_HEIGHT - ICON_SPACING;
 	    gfloat spacing = ICON_SPACING;
-	    if (count > 4) {
+	    if (count > device_info->home_screen_icon_columns) {
 		spacing = 3.0; 
 	    }
-            gfloat totalwidth = count*57.0 + (count-1) * spacing;
-	    xpos = (stage_area.x2 - totalwidth)/2.0 + (i*57.0) + (i*spacing);
-            clutter_actor_hide(it->label);
-            if (it->label_shadow) {
-                clutter_actor_hide(it->label_shadow);
-            }
+            gfloat totalwidth = count*device_info->home_screen_icon_width + (count-1) * spacing;
+	    xpos = (stage_area.x2 - totalwidth)/2.0 + (i*device_info->home_screen_icon_width) + (i*spacing);
+            sb_icon_actor_set_label_visible(SB_ICON_ACTOR(it->texture), FALSE);
 	    is_dock_folder = TRUE;
-            fldr = act;
         } else {
             clutter_actor_set_opacity(act, 64);
         }
@@ -1072,54 +1642,25 @@ static void folderview_open(SBItem *item)
     /* hide page indicators */
     clutter_actor_hide(page_indicator_group);
 
-    if (item->texture_shadow) {
-        clutter_actor_hide(item->texture_shadow);
-    }
-
-    /* make snapshot from the stage */
-    guchar *shot = clutter_stage_read_pixels(CLUTTER_STAGE(stage), 0, 0, stage_area.x2, stage_area.y2);
-    if (!shot) {
-        printf("Error creating stage snapshot!\n");
-        return;
-    }
+    /* the folder icon stays without shadow while it is open */
+    sb_icon_actor_set_shadow_visible(SB_ICON_ACTOR(item->texture), FALSE);
 
-    if (item->texture_shadow) {
-        clutter_actor_show(item->texture_shadow);
-    }
-
-    /* upper */
-    aniupper = clutter_group_new();
+    /* upper, split at the folder */
+    aniupper = gui_stage_clone_new(0.0, ypos);
     clutter_container_add_actor(CLUTTER_CONTAINER(stage), aniupper);
-    act = clutter_texture_new();
-    clutter_texture_set_from_rgb_data(CLUTTER_TEXTURE(act), shot, TRUE, stage_area.x2, ypos, stage_area.x2*4, 4, CLUTTER_TEXTURE_NONE, NULL);
-    clutter_container_add_actor(CLUTTER_CONTAINER(aniupper), act);
     clutter_actor_set_position(aniupper, 0, 0);
     clutter_actor_set_reactive(aniupper, TRUE);
     clutter_actor_show(aniupper);
     clutter_actor_raise_top(aniupper);
 
     /* lower */
-    anilower = clutter_group_new();
+    anilower = gui_stage_clone_new(ypos, (gfloat)(stage_area.y2)-ypos);
     clutter_container_add_actor(CLUTTER_CONTAINER(stage), anilower);
-    act = clutter_texture_new();
-    clutter_texture_set_from_rgb_data(CLUTTER_TEXTURE(act), shot, TRUE, stage_area.x2, stage_area.y2, stage_area.x2*4, 4, CLUTTER_TEXTURE_NONE, NULL);
-    clutter_actor_set_clip(act, 0.0, ypos, (gfloat)(stage_area.x2), (gfloat)(stage_area.y2)-ypos);
-    clutter_container_add_actor(CLUTTER_CONTAINER(anilower), act);
     clutter_actor_set_position(anilower, 0, 0);
     clutter_actor_set_reactive(anilower, TRUE);
     clutter_actor_show(anilower);
     clutter_actor_raise_top(anilower);
 
-    /* add a clone of the original folder icon */
-    act = clutter_clone_new(fldr);
-    if (is_dock_folder) {
-        clutter_container_add_actor(CLUTTER_CONTAINER(anilower), act);
-        clutter_actor_set_position(act, xpos, ypos+20.0);
-    } else {
-        clutter_container_add_actor(CLUTTER_CONTAINER(aniupper), act);
-        clutter_actor_set_position(act, xpos, ypos-80.0);
-    }
-
     /* create folder container */
     folder = clutter_group_new();
     clutter_container_add_actor(CLUTTER_CONTAINER(stage), folder);
@@ -1146,7 +1687,7 @@ static void folderview_open(SBItem *item)
     clutter_actor_set_position(trect, 16.0, 8.0);
     clutter_actor_set_size(trect, (gfloat)(stage_area.x2)-32.0, 24.0);
 
-    const gchar *ltext = clutter_text_get_text(CLUTTER_TEXT(item->label));
+    const gchar *ltext = sbitem_get_display_name(item);
     ClutterColor lcolor = {0, 0, 0, 255};
     ClutterActor *lbl = clutter_text_new_full(FOLDER_LARGE_FONT, ltext, &lcolor);
     clutter_container_add_actor(CLUTTER_CONTAINER(folder), lbl);
@@ -1166,10 +1707,16 @@ static void folderview_open(SBItem *item)
 
     /* calculate height */
     gfloat fh = 8.0 + 18.0 + 8.0;
-    if (item->subitems && (g_list_length(item->subitems) > 0)) {
-        fh += (((g_list_length(item->subitems)-1)/device_info->home_screen_icon_columns) + 1)*88.0;
+    if (item->subitems && (item->subitems->count > 0)) {
+        fh += (((MIN(item->subitems->count, FOLDER_ITEMS)-1)/device_info->icon_folder_columns) + 1)*ICON_ROW_HEIGHT;
     } else {
-        fh += 88.0;
+        fh += ICON_ROW_HEIGHT;
+    }
+
+    /* later pages are reached through the page dots */
+    if (page_indicator && (gui_folder_get_page_count(item) > 1)) {
+        gui_folder_page_dots_add(item, fh);
+        fh += FOLDER_DOTS_HEIGHT;
     }
 
     /* folder marker */
@@ -1186,8 +1733,11 @@ static void folderview_open(SBItem *item)
     }
 
     /* reparent the icons to the folder */
-    for (i = 0; i < g_list_length(item->subitems); i++) {
-        SBItem *si = g_list_nth_data(item->subitems, i);
+    for (i = 0; i < item->subitems->count; i++) {
+        SBItem *si = item->subitems->items[i];
+        if (!si->texture) {
+            continue;
+        }
         ClutterActor *a = clutter_actor_get_parent(si->texture);
         clutter_actor_reparent(a, folder);
         clutter_actor_set_position(a, 0, 0);
@@ -1217,13 +1767,134 @@ static void folderview_open(SBItem *item)
     clutter_actor_animate(aniupper, CLUTTER_EASE_IN_OUT_QUAD, FOLDER_ANIM_DURATION, "y", (gfloat) -move_up_by, NULL);
     clutter_actor_animate(anilower, CLUTTER_EASE_IN_OUT_QUAD, FOLDER_ANIM_DURATION, "y", (gfloat) fh-move_up_by, NULL);
 
-    free(shot);
-
     split_pos = ypos;
 
     clutter_threads_add_timeout(FOLDER_ANIM_DURATION, (GSourceFunc)folderview_open_finish, item);
 }
 
+static void gui_history_clear(GQueue *history)
+{
+    SBLayout *layout;
+
+    while ((layout = g_queue_pop_head(history)) != NULL) {
+        sblayout_unref(layout);
+    }
+}
+
+/* forget all steps and start over with what is shown now */
+static void gui_history_reset()
+{
+    gui_history_clear(undo_history);
+    gui_history_clear(redo_history);
+    if (layout_current) {
+        sblayout_unref(layout_current);
+        layout_current = NULL;
+    }
+    if (dockitems) {
+        layout_current = sblayout_new(dockitems, sbpages, NULL);
+    }
+}
+
+/* adds a step to the undo history if the layout was changed */
+static void gui_history_record()
+{
+    SBLayout *layout;
+
+    if (!layout_current) {
+        return;
+    }
+
+    layout = sblayout_new(dockitems, sbpages, layout_current);
+    if (sblayout_equal(layout, layout_current)) {
+        sblayout_unref(layout);
+        return;
+    }
+
+    g_queue_push_head(undo_history, layout_current);
+    if (g_queue_get_length(undo_history) > UNDO_LEVELS) {
+        sblayout_unref(g_queue_pop_tail(undo_history));
+    }
+    layout_current = layout;
+    gui_history_clear(redo_history);
+}
+
+static gboolean gui_history_restore_page(SBLayoutNode *from, SBLayoutNode *to, SBPage *page, gboolean is_dock)
+{
+    guint i;
+
+    if (from == to) {
+        return FALSE;
+    }
+
+    sblayout_node_apply(to, page);
+    for (i = 0; i < to->count; i++) {
+        SBItem *item = to->items[i];
+        gui_item_move_to_dock(item, is_dock);
+        if (item->is_folder && item->subitems) {
+            SBLayoutNode *contents = sblayout_node_get_folder(to, i);
+            if (contents && sblayout_node_apply(contents, item->subitems)) {
+                gui_folder_redraw_subitems(item);
+                if (item == selected_folder) {
+                    gui_folder_align_icons(item, TRUE);
+                }
+            }
+        }
+    }
+    return TRUE;
+}
+
+/* moves the items back to where they were in layout, changed pages only */
+static void gui_history_restore(SBLayout *from, SBLayout *to)
+{
+    guint i;
+
+    if (gui_history_restore_page(from->dock, to->dock, dockitems, TRUE)) {
+        gui_dock_align_icons(TRUE);
+    }
+
+    while (sbpages->len < to->page_count) {
+        gui_page_indicator_group_add(gui_pages_append(), sbpages->len - 1);
+    }
+    for (i = 0; i < to->page_count; i++) {
+        SBLayoutNode *prev = (i < from->page_count) ? from->pages[i] : NULL;
+        gui_history_restore_page(prev, to->pages[i], gui_get_page(i), FALSE);
+    }
+    /* all items are placed on the remaining pages by now */
+    for (i = to->page_count; i < sbpages->len; i++) {
+        sbpage_clear(gui_get_page(i));
+    }
+    gui_pages_remove_empty();
+
+    for (i = 0; i < to->page_count; i++) {
+        if ((i >= from->page_count) || (from->pages[i] != to->pages[i])) {
+            gui_page_align_icons(i, TRUE);
+        }
+    }
+
+    if (current_page >= (int)sbpages->len) {
+        gui_set_current_page(sbpages->len - 1, FALSE);
+    }
+}
+
+/* undo with (undo_history, redo_history), redo the other way around */
+static void gui_history_step(GQueue *history, GQueue *opposite)
+{
+    SBLayout *layout;
+
+    if (selected_item || !layout_current) {
+        /* not while an item is dragged around */
+        return;
+    }
+
+    layout = g_queue_pop_head(history);
+    if (!layout) {
+        return;
+    }
+    gui_history_restore(layout_current, layout);
+    g_queue_push_head(opposite, layout_current);
+    layout_current = layout;
+}
+
 static gboolean item_button_press_cb(ClutterActor *actor, ClutterButtonEvent *event, gpointer user_data)
 {
     if (!user_data) {
@@ -1255,7 +1926,7 @@ static gboolean item_button_press_cb(ClutterActor *actor, ClutterButtonEvent *ev
         return FALSE;
     }
 
-    char *strval = sbitem_get_display_name(item);
+    const char *strval = sbitem_get_display_name(item);
 
     g_mutex_lock(selected_mutex);
     debug_printf("%s: %s mouse pressed\n", __func__, strval);
@@ -1265,11 +1936,7 @@ static gboolean item_button_press_cb(ClutterActor *actor, ClutterButtonEvent *ev
         gfloat diffy = 0.0;
         ClutterActor *sc = clutter_actor_get_parent(actor);
         if (item->is_dock_item) {
-            clutter_text_set_color(CLUTTER_TEXT(item->label), &item_text_color);
-            clutter_actor_set_y(item->label, clutter_actor_get_y(item->texture) + device_info->home_screen_icon_height);
-            if (item->label_shadow) {
-                clutter_actor_set_y(item->label_shadow, clutter_actor_get_y(item->texture) + device_info->home_screen_icon_height + 1.0);
-            }
+            gui_item_set_label(item, label_cache_set_color(label_cache, item->label, &item_text_color));
             diffx = dock_area.x1;
             diffy = dock_area.y1;
         } else {
@@ -1287,13 +1954,12 @@ static gboolean item_button_press_cb(ClutterActor *actor, ClutterButtonEvent *ev
         selected_item = item;
         start_x = event->x;
         start_y = event->y;
+        gui_drop_target_reset();
     }
     g_mutex_unlock(selected_mutex);
 
     /* add pages and page indicators as needed */
-    GList *page = NULL;
-    gui_page_indicator_group_add(page, g_list_length(sbpages));
-    sbpages = g_list_append(sbpages, page);
+    gui_page_indicator_group_add(gui_pages_append(), sbpages->len - 1);
 
     return TRUE;
 }
@@ -1315,11 +1981,13 @@ static gboolean item_button_release_cb(ClutterActor *actor, ClutterButtonEvent *
     }
     item->enabled = FALSE;
 
-    char *strval = sbitem_get_display_name(item);
+    gui_drag_finish();
+
+    const char *strval = sbitem_get_display_name(item);
 
     /* remove empty pages and page indicators as needed */
     gui_pages_remove_empty();
-    int count = g_list_length(sbpages);
+    int count = sbpages->len;
     if (current_page >= count) {
         gui_set_current_page(count-1, FALSE);
     }
@@ -1335,11 +2003,7 @@ static gboolean item_button_release_cb(ClutterActor *actor, ClutterButtonEvent *
                                      clutter_actor_get_y(actor) + clutter_actor_get_height(actor) / 2);
         clutter_actor_set_opacity(sc, 255);
         if (item->is_dock_item) {
-            clutter_text_set_color(CLUTTER_TEXT(item->label), &dock_item_text_color);
-            clutter_actor_set_y(item->label, clutter_actor_get_y(item->texture) + device_info->home_screen_icon_height);
-            if (item->label_shadow) {
-                clutter_actor_set_y(item->label_shadow, clutter_actor_get_y(item->texture) + device_info->home_screen_icon_height + 1.0);
-            }
+            gui_item_set_label(item, label_cache_set_color(label_cache, item->label, &dock_item_text_color));
             clutter_actor_reparent(sc, the_dock);
             clutter_actor_set_position(sc,
                                        clutter_actor_get_x(sc) - dock_area.x1, clutter_actor_get_y(sc) - dock_area.y1);
@@ -1357,6 +2021,8 @@ static gboolean item_button_release_cb(ClutterActor *actor, ClutterButtonEvent *
     start_x = 0.0;
     start_y = 0.0;
 
+    gui_history_record();
+
     clutter_threads_add_timeout(ICON_MOVEMENT_DURATION, (GSourceFunc)item_enable, (gpointer)item);
 
     g_mutex_unlock(selected_mutex);
@@ -1366,17 +2032,55 @@ static gboolean item_button_release_cb(ClutterActor *actor, ClutterButtonEvent *
 
 static gboolean stage_key_press_cb(ClutterActor *actor, ClutterEvent *event, gpointer user_data)
 {
-    if (!user_data || (event->type != CLUTTER_KEY_PRESS)) {
+    if (event->type != CLUTTER_KEY_PRESS) {
         return FALSE;
     }
 
     guint symbol = clutter_event_get_key_symbol(event);
+    ClutterModifierType state = clutter_event_get_state(event);
+    if (state & CLUTTER_CONTROL_MASK) {
+        /* keep the layout alone while the folder name is edited */
+        ClutterActor *focus = clutter_stage_get_key_focus(CLUTTER_STAGE(stage));
+        if (focus && CLUTTER_IS_TEXT(focus) && clutter_text_get_editable(CLUTTER_TEXT(focus))) {
+            return FALSE;
+        }
+        switch(symbol) {
+            case CLUTTER_z:
+            case CLUTTER_Z:
+            if (state & CLUTTER_SHIFT_MASK) {
+                gui_history_step(redo_history, undo_history);
+            } else {
+                gui_history_step(undo_history, redo_history);
+            }
+            break;
+            case CLUTTER_y:
+            case CLUTTER_Y:
+            gui_history_step(redo_history, undo_history);
+            break;
+            default:
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    if (!user_data) {
+        return FALSE;
+    }
+
     switch(symbol) {
         case CLUTTER_Right:
-        gui_show_next_page();
+        if (selected_folder) {
+            gui_folder_show_page(selected_folder, folder_page + 1);
+        } else {
+            gui_show_next_page();
+        }
         break;
         case CLUTTER_Left:
-        gui_show_previous_page();
+        if (selected_folder) {
+            gui_folder_show_page(selected_folder, (gint)folder_page - 1);
+        } else {
+            gui_show_previous_page();
+        }
         break;
         default:
         return FALSE;
@@ -1405,7 +2109,7 @@ static gboolean subitem_button_press_cb(ClutterActor *actor, ClutterButtonEvent
         return FALSE;
     }
 
-    char *strval = sbitem_get_display_name(item);
+    const char *strval = sbitem_get_display_name(item);
 
     g_mutex_lock(selected_mutex);
     debug_printf("%s: %s mouse pressed\n", __func__, strval);
@@ -1428,6 +2132,7 @@ static gboolean subitem_button_press_cb(ClutterActor *actor, ClutterButtonEvent
         selected_item = item;
         start_x = event->x;
         start_y = event->y;
+        gui_drop_target_reset();
     }
     g_mutex_unlock(selected_mutex);
 
@@ -1451,7 +2156,9 @@ static gboolean subitem_button_release_cb(ClutterActor *actor, ClutterButtonEven
     }
     item->enabled = FALSE;
 
-    char *strval = sbitem_get_display_name(item);
+    gui_drag_finish();
+
+    const char *strval = sbitem_get_display_name(item);
 
     g_mutex_lock(selected_mutex);
     debug_printf("%s: %s mouse released\n", __func__, strval);
@@ -1474,6 +2181,8 @@ static gboolean subitem_button_release_cb(ClutterActor *actor, ClutterButtonEven
     start_x = 0.0;
     start_y = 0.0;
 
+    gui_history_record();
+
     clutter_threads_add_timeout(ICON_MOVEMENT_DURATION, (GSourceFunc)item_enable, (gpointer)item);
 
     g_mutex_unlock(selected_mutex);
@@ -1487,104 +2196,118 @@ static gboolean subitem_button_release_cb(ClutterActor *actor, ClutterButtonEven
 static void gui_folder_draw_subitems(SBItem *item)
 {
     ClutterActor *grp = clutter_actor_get_parent(item->texture);
-    ClutterActor *minigrp = clutter_group_new();
-    clutter_actor_set_name(minigrp, "mini");
-    clutter_container_add_actor(CLUTTER_CONTAINER(grp), minigrp);
     guint i;
-    for (i = 0; i < g_list_length(item->subitems); i++) {
-        SBItem *subitem = (SBItem*)g_list_nth_data(item->subitems, i);
-        if (subitem && subitem->texture && !subitem->drawn && subitem->node) {
+    for (i = 0; i < item->subitems->count; i++) {
+        SBItem *subitem = item->subitems->items[i];
+        if (subitem && subitem->texture && !subitem->drawn) {
             subitem->is_dock_item = FALSE;
             ClutterActor *sgrp = clutter_group_new();
-            ClutterActor *actor;
-            // icon shadow
-            actor = subitem->texture_shadow;
-            if (actor) {
-                clutter_container_add_actor(CLUTTER_CONTAINER(sgrp), actor);
-                clutter_actor_set_position(actor, -12.0, -12.0);
-                clutter_actor_show(actor);
-            }
-            // label shadow
-            actor = subitem->label_shadow;
-            if (actor) {
-                clutter_container_add_actor(CLUTTER_CONTAINER(sgrp), actor);
-                clutter_actor_set_position(actor, (device_info->home_screen_icon_width - clutter_actor_get_width(actor)) / 2 + 1.0, device_info->home_screen_icon_height + 1.0);
-                clutter_actor_show(actor);
-            }
-
-            actor = subitem->texture;
+            ClutterActor *actor = subitem->texture;
             clutter_container_add_actor(CLUTTER_CONTAINER(sgrp), actor);
             clutter_actor_set_position(actor, 0.0, 0.0);
             clutter_actor_set_reactive(actor, TRUE);
             g_signal_connect(actor, "button-press-event", G_CALLBACK(subitem_button_press_cb), subitem);
             g_signal_connect(actor, "button-release-event", G_CALLBACK(subitem_button_release_cb), subitem);
             clutter_actor_show(actor);
+            gui_item_set_label(subitem, label_cache_set_color(label_cache, subitem->label, &item_text_color));
 
-            /* setup label */
-            actor = subitem->label;
-            clutter_actor_set_position(actor, (device_info->home_screen_icon_width - clutter_actor_get_width(actor)) / 2, device_info->home_screen_icon_height);
-            clutter_text_set_color(CLUTTER_TEXT(actor), &item_text_color);
-            clutter_actor_show(actor);
-            clutter_container_add_actor(CLUTTER_CONTAINER(sgrp), actor);
             clutter_container_add_actor(CLUTTER_CONTAINER(grp), sgrp);
             clutter_actor_hide(sgrp);
-
-            ClutterActor *suba = clutter_clone_new(subitem->texture);
-            clutter_actor_unparent(suba);
-            clutter_container_add_actor(CLUTTER_CONTAINER(minigrp), suba);
-            clutter_actor_set_scale(suba, 0.22, 0.22);
-            clutter_actor_set_position(suba, 8.0 + (i%3)*ICON_SPACING, 8.0 + ((double)(int)((int)i/3))*ICON_SPACING);
-            if (i < 9)
-                clutter_actor_show(suba);
-            else
-                clutter_actor_hide(suba);
             subitem->drawn = TRUE;
         }
     }
+    gui_folder_redraw_subitems(item);
+}
+
+/* creates the actor group of item and adds it to the dock or the pages */
+static void gui_item_draw(SBItem *item, gboolean is_dock_item)
+{
+    ClutterActor *grp = clutter_group_new();
+    ClutterActor *actor;
+
+    item->is_dock_item = is_dock_item;
+    actor = item->texture;
+    clutter_container_add_actor(CLUTTER_CONTAINER(grp), actor);
+    clutter_actor_set_position(actor, 0.0, 0.0);
+    clutter_actor_set_reactive(actor, TRUE);
+    g_signal_connect(actor, "button-press-event", G_CALLBACK(item_button_press_cb), item);
+    g_signal_connect(actor, "button-release-event", G_CALLBACK(item_button_release_cb), item);
+    clutter_actor_show(actor);
+    gui_item_set_label(item, label_cache_set_color(label_cache, item->label, is_dock_item ? &dock_item_text_color : &item_text_color));
+    clutter_container_add_actor(CLUTTER_CONTAINER(is_dock_item ? the_dock : the_sb), grp);
+    item->drawn = TRUE;
+}
+
+static gboolean gui_align_pending_cb(gpointer data)
+{
+    guint i;
+
+    if (align_dock_pending) {
+        gui_dock_align_icons(FALSE);
+    }
+    /* pages might be gone by now, only align the ones still there */
+    for (i = 0; i < sbpages->len; i++) {
+        SBPage *page = gui_get_page(i);
+        if (g_hash_table_lookup(align_pending, page)) {
+            gui_page_align_icons(i, FALSE);
+        }
+    }
+    g_hash_table_remove_all(align_pending);
+    align_dock_pending = FALSE;
+    align_repaint_id = 0;
+
+    return FALSE;
+}
+
+/* aligns page (or the dock) before the next frame is drawn */
+static void gui_queue_align(SBPage *page)
+{
+    if (page == dockitems) {
+        align_dock_pending = TRUE;
+    } else {
+        g_hash_table_insert(align_pending, page, page);
+    }
+    if (!align_repaint_id) {
+        align_repaint_id = clutter_threads_add_repaint_func(gui_align_pending_cb, NULL, NULL);
+        clutter_actor_queue_redraw(stage);
+    }
+}
+
+/* shows a freshly loaded item in its place */
+static void gui_item_attach(SBItem *item)
+{
+    SBPage *page = item->page;
+
+    if (!page || !item->texture) {
+        return;
+    }
+    if (page->folder) {
+        /* the folder draws its items once it is drawn itself */
+        if (page->folder->drawn) {
+            gui_folder_draw_subitems(page->folder);
+        }
+        return;
+    }
+    if (!item->drawn) {
+        gui_item_draw(item, (page == dockitems));
+    }
+    if (item->is_folder && item->subitems) {
+        gui_folder_draw_subitems(item);
+    }
+    gui_queue_align(page);
 }
 
 static void gui_show_icons()
 {
     guint i;
     guint j;
-    gfloat ypos;
-    gfloat xpos;
 
     if (dockitems) {
-        xpos = 0.0;
-        ypos = 0.0;
         debug_printf("%s: showing dock icons\n", __func__);
-        for (i = 0; i < g_list_length(dockitems); i++) {
-            SBItem *item = (SBItem*)g_list_nth_data(dockitems, i);
-            if (item && item->texture && !item->drawn && item->node) {
-                item->is_dock_item = TRUE;
-                ClutterActor *grp = clutter_group_new();
-                ClutterActor *actor;
-                // icon shadow
-                actor = item->texture_shadow;
-                if (actor) {
-                    clutter_container_add_actor(CLUTTER_CONTAINER(grp), actor);
-                    clutter_actor_set_position(actor, xpos-12, ypos-12);
-                }
-                // label shadow
-                actor = item->label_shadow;
-                if (actor) {
-                    clutter_container_add_actor(CLUTTER_CONTAINER(grp), actor);
-                    clutter_actor_set_position(actor, xpos + (device_info->home_screen_icon_width - clutter_actor_get_width(actor)) / 2 + 1.0, ypos + device_info->home_screen_icon_height + 1.0);
-                }
-                actor = item->texture;
-                clutter_container_add_actor(CLUTTER_CONTAINER(grp), actor);
-                clutter_actor_set_position(actor, xpos, ypos);
-                clutter_actor_set_reactive(actor, TRUE);
-                g_signal_connect(actor, "button-press-event", G_CALLBACK(item_button_press_cb), item);
-                g_signal_connect(actor, "button-release-event", G_CALLBACK(item_button_release_cb), item);
-                clutter_actor_show(actor);
-                actor = item->label;
-                clutter_actor_set_position(actor, xpos + (device_info->home_screen_icon_width - clutter_actor_get_width(actor)) / 2, ypos + device_info->home_screen_icon_height);
-                clutter_text_set_color(CLUTTER_TEXT(actor), &dock_item_text_color);
-                clutter_container_add_actor(CLUTTER_CONTAINER(grp), actor);
-                clutter_container_add_actor(CLUTTER_CONTAINER(the_dock), grp);
-		item->drawn = TRUE;
+        for (i = 0; i < dockitems->count; i++) {
+            SBItem *item = dockitems->items[i];
+            if (item && item->texture && !item->drawn) {
+                gui_item_draw(item, TRUE);
             }
             /* process subitems */
             if (item->texture && item->is_folder && item->subitems) {
@@ -1595,44 +2318,14 @@ static void gui_show_icons()
     }
     clutter_stage_ensure_redraw(CLUTTER_STAGE(stage));
     if (sbpages) {
-        debug_printf("%s: processing %d pages\n", __func__, g_list_length(sbpages));
-        for (j = 0; j < g_list_length(sbpages); j++) {
-            GList *cpage = g_list_nth_data(sbpages, j);
-            ypos = 0.0;
-            xpos = 0.0;
+        debug_printf("%s: processing %d pages\n", __func__, sbpages->len);
+        for (j = 0; j < sbpages->len; j++) {
+            SBPage *cpage = gui_get_page(j);
             debug_printf("%s: showing page icons for page %d\n", __func__, j);
-            for (i = 0; i < g_list_length(cpage); i++) {
-                SBItem *item = (SBItem*)g_list_nth_data(cpage, i);
-                if (item && item->texture && !item->drawn && item->node) {
-                    item->is_dock_item = FALSE;
-                    ClutterActor *grp = clutter_group_new();
-                    ClutterActor *actor;
-                    // icon shadow
-                    actor = item->texture_shadow;
-                    if (actor) {
-                        clutter_container_add_actor(CLUTTER_CONTAINER(grp), actor);
-                        clutter_actor_set_position(actor, xpos-12.0, ypos-12.0);
-                    }
-
-                    // label shadow
-                    actor = item->label_shadow;
-                    if (actor) {
-                        clutter_container_add_actor(CLUTTER_CONTAINER(grp), actor);
-                        clutter_actor_set_position(actor, xpos + (device_info->home_screen_icon_width - clutter_actor_get_width(actor)) / 2 + 1.0, ypos + device_info->home_screen_icon_height + 1.0);
-                    }
-                    actor = item->texture;
-                    clutter_container_add_actor(CLUTTER_CONTAINER(grp), actor);
-                    clutter_actor_set_position(actor, xpos, ypos);
-                    clutter_actor_set_reactive(actor, TRUE);
-                    g_signal_connect(actor, "button-press-event", G_CALLBACK(item_button_press_cb), item);
-                    g_signal_connect(actor, "button-release-event", G_CALLBACK(item_button_release_cb), item);
-                    clutter_actor_show(actor);
-                    actor = item->label;
-                    clutter_text_set_color(CLUTTER_TEXT(actor), &item_text_color);
-                    clutter_actor_set_position(actor, xpos + (device_info->home_screen_icon_width - clutter_actor_get_width(actor)) / 2, ypos + device_info->home_screen_icon_height);
-                    clutter_container_add_actor(CLUTTER_CONTAINER(grp), actor);
-                    clutter_container_add_actor(CLUTTER_CONTAINER(the_sb), grp);
-		    item->drawn = TRUE;
+            for (i = 0; i < cpage->count; i++) {
+                SBItem *item = cpage->items[i];
+                if (item && item->texture && !item->drawn) {
+                    gui_item_draw(item, FALSE);
                 }
                 /* process subitems */
                 if (item->texture && item->is_folder && item->subitems) {
@@ -1649,61 +2342,262 @@ static void sbitem_texture_load_finished(ClutterTexture *texture, gpointer error
 {
     SBItem *item = (SBItem *)data;
 
-    if (item->texture_shadow) {
-        clutter_actor_show(item->texture_shadow);
+    sb_icon_actor_set_shadow_visible(SB_ICON_ACTOR(item->texture), TRUE);
+    sb_icon_actor_set_label_visible(SB_ICON_ACTOR(item->texture), TRUE);
+}
+
+#ifdef HAVE_CLUTTER_1_2
+static gboolean gui_icon_atlas_compact_cb(gpointer data)
+{
+    guint moved = icon_atlas_compact(icon_atlas);
+    IconAtlasStats stats;
+
+    if (mini_atlas) {
+        moved += icon_atlas_compact(mini_atlas);
+    }
+    icon_atlas_get_stats(icon_atlas, &stats);
+    debug_printf("%s: moved %d icons, %d icons in %d textures now\n", __func__, moved, stats.icons, stats.textures);
+    icon_atlas_compact_source = 0;
+    return FALSE;
+}
+
+/* the texture actor is gone, give its cell back */
+static void gui_icon_atlas_entry_free(gpointer data)
+{
+    icon_atlas_remove(icon_atlas, (IconAtlasEntry*)data);
+    if (!icon_atlas_compact_source && icon_atlas_is_fragmented(icon_atlas)) {
+        icon_atlas_compact_source = clutter_threads_add_idle(gui_icon_atlas_compact_cb, NULL);
+    }
+}
+
+static void gui_mini_atlas_entry_free(gpointer data)
+{
+    icon_atlas_remove(mini_atlas, (IconAtlasEntry*)data);
+    if (!icon_atlas_compact_source && icon_atlas_is_fragmented(mini_atlas)) {
+        icon_atlas_compact_source = clutter_threads_add_idle(gui_icon_atlas_compact_cb, NULL);
+    }
+}
+
+static void gui_icon_atlas_moved_cb(IconAtlasEntry *entry, gpointer user_data)
+{
+    clutter_texture_set_cogl_texture(CLUTTER_TEXTURE(entry->data), entry->texture);
+}
+#endif
+
+/* puts the icon into the shared atlas, FALSE if it needs a texture of its own */
+static gboolean gui_icon_upload_atlas(ClutterActor *texture, GdkPixbuf *pixbuf, gboolean mini)
+{
+#ifdef HAVE_CLUTTER_1_2
+    IconAtlasEntry *entry;
+
+    if (!icon_atlas) {
+        icon_atlas = icon_atlas_new(device_info->home_screen_icon_width, device_info->home_screen_icon_height, gui_icon_atlas_moved_cb, NULL);
+    }
+    if (!mini_atlas && mini) {
+        /* all icons are decoded to the same size, so are their levels */
+        mini_atlas = icon_atlas_new(gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf), gui_icon_atlas_moved_cb, NULL);
+    }
+    entry = icon_atlas_add(mini ? mini_atlas : icon_atlas, gdk_pixbuf_get_pixels(pixbuf),
+                           gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf),
+                           gdk_pixbuf_get_rowstride(pixbuf), texture);
+    if (!entry) {
+        return FALSE;
+    }
+    clutter_texture_set_cogl_texture(CLUTTER_TEXTURE(texture), entry->texture);
+    g_object_set_data_full(G_OBJECT(texture), "atlas-entry", entry, mini ? gui_mini_atlas_entry_free : gui_icon_atlas_entry_free);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+static void gui_icon_upload_texture(ClutterActor *texture, GdkPixbuf *pixbuf, gboolean mini, GError **err)
+{
+    if (!gui_icon_upload_atlas(texture, pixbuf, mini)) {
+        g_object_set_data(G_OBJECT(texture), "atlas-entry", NULL);
+        clutter_texture_set_from_rgb_data(CLUTTER_TEXTURE(texture),
+                                          gdk_pixbuf_get_pixels(pixbuf), TRUE,
+                                          gdk_pixbuf_get_width(pixbuf),
+                                          gdk_pixbuf_get_height(pixbuf),
+                                          gdk_pixbuf_get_rowstride(pixbuf), 4,
+                                          CLUTTER_TEXTURE_RGB_FLAG_PREMULT, err);
+    }
+}
+
+/* only the items of folders are drawn small, by the folder icon */
+static gboolean gui_item_in_folder(SBItem *item)
+{
+    return (item->page && item->page->folder);
+}
+
+/* runs in the main loop, uploads the decoded pixels */
+static void gui_icon_upload(IconDecodeJob *job)
+{
+    ClutterActor *texture = CLUTTER_ACTOR(job->data);
+    SBItem *item = (SBItem*)g_object_get_data(G_OBJECT(texture), "sbitem");
+    GError *err = NULL;
+
+    if (item && job->pixbuf && !gui_item_is_resident(item)) {
+        /* loaded for a page out of sight, uploaded once it is shown */
+        gui_item_evict_texture(item);
+        sbitem_texture_load_finished(CLUTTER_TEXTURE(texture), NULL, item);
+    } else if (item && job->pixbuf) {
+        gui_icon_upload_texture(texture, job->pixbuf, FALSE, &err);
+        if ((job->n_levels > 0) && gui_item_in_folder(item) && !err) {
+            gboolean created = !item->mini_texture;
+            if (created) {
+                item->mini_texture = g_object_ref_sink(clutter_texture_new());
+            }
+            gui_icon_upload_texture(item->mini_texture, icon_decode_job_get_level(job, FOLDER_MINI_WIDTH), TRUE, &err);
+            if (created) {
+                gui_folder_redraw_subitems(item->page->folder);
+            }
+        }
+        sbitem_texture_load_finished(CLUTTER_TEXTURE(texture), err, item);
     }
-    clutter_actor_show(item->label);
-    if (item->label_shadow) {
-        clutter_actor_show(item->label_shadow);
+    if (job->error) {
+        fprintf(stderr, "ERROR: %s\n", job->error->message);
     }
+    if (err) {
+        fprintf(stderr, "ERROR: %s\n", err->message);
+        g_error_free(err);
+    }
+
+    g_object_unref(texture);
+    icon_decode_job_free(job);
+}
+
+/* uploads would make page and folder animations stutter */
+static gboolean gui_is_animating()
+{
+    if (clutter_actor_get_animation(the_sb)) {
+        return TRUE;
+    }
+    if (aniupper && clutter_actor_get_animation(aniupper)) {
+        return TRUE;
+    }
+    if (folder && clutter_actor_get_animation(folder)) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* runs before each frame as long as there is something to upload */
+static gboolean gui_upload_frame_cb(gpointer data)
+{
+    gint64 start = gui_get_time();
+    gint64 now = start;
+    IconDecodeJob *job;
+
+    /* a frame that took much longer than it should right after uploading */
+    if (upload_last_frame_busy && (start - upload_last_frame > FRAME_TIME * 3 / 2)) {
+        upload_stats.missed_frames += (start - upload_last_frame) / FRAME_TIME - 1;
+    }
+    upload_last_frame = start;
+    upload_last_frame_busy = FALSE;
+
+    if (gui_is_animating()) {
+        clutter_actor_queue_redraw(stage);
+        return TRUE;
+    }
+
+    while ((now - start < UPLOAD_FRAME_BUDGET) && ((job = g_async_queue_try_pop(upload_queue)) != NULL)) {
+        gui_icon_upload(job);
+        upload_stats.uploads++;
+        now = gui_get_time();
+    }
+    if (now > start) {
+        upload_stats.frames++;
+        upload_stats.upload_time += now - start;
+        upload_stats.max_frame_time = MAX(upload_stats.max_frame_time, now - start);
+        upload_last_frame_busy = TRUE;
+    }
+
+    if (g_async_queue_length(upload_queue) > 0) {
+        clutter_actor_queue_redraw(stage);
+        return TRUE;
+    }
+    /* a decoder thread might have queued a job right before this */
+    g_atomic_int_set(&upload_scheduled, 0);
+    if ((g_async_queue_length(upload_queue) > 0) && g_atomic_int_compare_and_exchange(&upload_scheduled, 0, 1)) {
+        clutter_actor_queue_redraw(stage);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean gui_upload_start(gpointer data)
+{
+    upload_last_frame_busy = FALSE;
+    clutter_threads_add_repaint_func(gui_upload_frame_cb, NULL, NULL);
+    clutter_actor_queue_redraw(stage);
+    return FALSE;
+}
+
+static void gui_icon_decoded_cb(IconDecodeJob *job, gpointer user_data)
+{
+    g_async_queue_push(upload_queue, job);
+    if (g_atomic_int_compare_and_exchange(&upload_scheduled, 0, 1)) {
+        clutter_threads_add_idle((GSourceFunc)gui_upload_start, NULL);
+    }
+}
+
+static void gui_item_decode(SBItem *item, const char *icon_filename, guint priority)
+{
+    g_object_ref(item->texture);
+    icon_decoder_push(icon_decoder, icon_filename, device_info->home_screen_icon_width, device_info->home_screen_icon_height,
+                      gui_item_in_folder(item) ? FOLDER_MINI_WIDTH : 0, priority, item->texture);
+}
+
+/* the strings are interned, so threads do not need to touch the item */
+static SBItemJob *gui_item_job_new(SBItem *item)
+{
+    SBItemJob *job = g_new0(SBItemJob, 1);
+    job->item = item;
+    job->generation = load_generation;
+    job->icon_filename = sbitem_get_icon_filename(item);
+    job->display_identifier = sbitem_get_display_identifier(item);
+    return job;
 }
 
 static gboolean sbitem_texture_new(gpointer data)
 {
     SBItem *item = (SBItem *)data;
-    char *icon_filename;
-    if (item->is_folder) {
-        icon_filename = g_strdup(SBMGR_DATA "/folder.png");
-    } else {
-        icon_filename = sbitem_get_icon_filename(item);
-    }
+    const char *icon_filename = gui_item_get_icon_filename(item);
     GError *err = NULL;
 
-    /* create and load texture */
-    ClutterActor *actor = clutter_texture_new();
-    clutter_texture_set_load_async(CLUTTER_TEXTURE(actor), TRUE);
-    g_signal_connect(actor, "load-finished", G_CALLBACK(sbitem_texture_load_finished), (gpointer)item); 
+    /* create texture, it is filled once the icon is decoded */
+    ClutterActor *actor = sb_icon_actor_new();
+    g_object_set_data(G_OBJECT(actor), "sbitem", item);
     clutter_actor_set_size(actor, device_info->home_screen_icon_width, device_info->home_screen_icon_height);
     clutter_actor_set_scale(actor, 1.0, 1.0);
 
     /* create item */
     item->texture = actor;
 
+    /* shadow and label are painted by the icon, shown once it is loaded */
     if (wallpaper) {
-        actor = clutter_clone_new(icon_shadow);
-        clutter_actor_hide(actor);
-        clutter_actor_set_size(actor, device_info->home_screen_icon_width+24.0, device_info->home_screen_icon_height+24.0);
-        item->texture_shadow = actor;
+        sb_icon_actor_set_shadow(SB_ICON_ACTOR(item->texture), icon_shadow, 12.0);
     }
 
-    char *txtval = sbitem_get_display_name(item);
+    const char *txtval = sbitem_get_display_name(item);
     if (txtval) {
-        item->label = clutter_text_new_with_text(ITEM_FONT, txtval);
-        clutter_actor_hide(item->label);
-        if (wallpaper) {
-            item->label_shadow = clutter_text_new_full(ITEM_FONT, txtval, &label_shadow_color);
-            clutter_actor_hide(item->label_shadow);
-        }
+        gui_item_set_label(item, label_cache_ref(label_cache, txtval, ITEM_FONT, &item_text_color, wallpaper ? &label_shadow_color : NULL));
     }
     if (err) {
         fprintf(stderr, "ERROR: %s\n", err->message);
         g_error_free(err);
     }
 
-    clutter_texture_set_from_file(CLUTTER_TEXTURE(item->texture), icon_filename, &err);
+    gui_item_decode(item, icon_filename, icon_decode_seq++);
 
-    /* FIXME: Optimize! Do not traverse whole iconlist, just this icon */
-    gui_show_icons();
+    gui_item_attach(item);
+
+    /* a lazily loaded icon of the open folder */
+    if (selected_folder && folder && item->page && (item->page->folder == selected_folder)) {
+        clutter_actor_reparent(clutter_actor_get_parent(item->texture), folder);
+        gui_folder_align_icons(selected_folder, FALSE);
+    }
 
     g_mutex_lock(icon_loader_mutex);
     icons_loaded++;
@@ -1712,140 +2606,426 @@ static gboolean sbitem_texture_new(gpointer data)
     return FALSE;
 }
 
+static gboolean sbitem_texture_new_cb(gpointer data)
+{
+    SBItemJob *job = (SBItemJob *)data;
+
+    if (job->generation == load_generation) {
+        sbitem_texture_new(job->item);
+    }
+    g_free(job);
+
+    return FALSE;
+}
+
+static void gui_item_texture_new_later(SBItem *item)
+{
+    clutter_threads_add_idle((GSourceFunc)sbitem_texture_new_cb, gui_item_job_new(item));
+}
+
 static gpointer sbitem_thread_load_texture(gpointer data)
 {
-    SBItem *item = (SBItem *)data;
-    char *icon_filename = sbitem_get_icon_filename(item);
-    char *display_identifier = sbitem_get_display_identifier(item);
+    SBItemJob *job = (SBItemJob *)data;
+    const char *icon_filename = job->icon_filename;
+    const char *display_identifier = job->display_identifier;
     GError *err = NULL;
+    gboolean res = FALSE;
 
     debug_printf("%s: loading icon texture for '%s'\n", __func__, display_identifier);
 
-    if (device_sbs_save_icon(sbc, display_identifier, icon_filename, &err)) {
+    g_mutex_lock(icon_loader_mutex);
+    if (sbc) {
+        res = device_sbs_save_icon(sbc, display_identifier, icon_filename, &err);
+    }
+    g_mutex_unlock(icon_loader_mutex);
+
+    if (res) {
         /* load texture in the clutter main loop */
-        clutter_threads_add_idle((GSourceFunc)sbitem_texture_new, item);
-    } else {
+        clutter_threads_add_idle((GSourceFunc)sbitem_texture_new_cb, job);
+        return NULL;
+    }
+    if (err) {
         fprintf(stderr, "ERROR: %s\n", err->message);
         g_error_free(err);
     }
-    g_free(icon_filename);
+    g_free(job);
 
     return NULL;
 }
 
-static guint gui_load_icon_row(plist_t items, GList **row)
+static gboolean sbitem_texture_reload(gpointer data)
 {
-    int i;
-    int count;
-    int icon_count = 0;
-    SBItem *item = NULL;
+    SBItemJob *job = (SBItemJob *)data;
+    SBItem *item = job->item;
 
-    count = plist_array_get_size(items);
-    for (i = 0; i < count; i++) {
-        plist_t icon_info = plist_array_get_item(items, i);
-        plist_t subitems = plist_dict_get_item(icon_info, "iconLists");
-        if (subitems) {
-            /* this is a folder, so we need to load the subitems */
-            GList *folderitems = NULL;
-            if (plist_get_node_type(subitems) == PLIST_ARRAY) {
-                subitems = plist_array_get_item(subitems, 0);
-                if (plist_get_node_type(subitems) == PLIST_ARRAY) {
-                    icon_count += gui_load_icon_row(subitems, &folderitems);
-                }
-            }
-            if (folderitems) {
-                item = sbitem_new_with_subitems(icon_info, folderitems);
-                if (item != NULL) {
-                    clutter_threads_add_idle((GSourceFunc)sbitem_texture_new, item);
-                    *row = g_list_append(*row, item);
-                    icon_count++;
-                }
-            }
-        } else {
-            item = sbitem_new(icon_info);
-            if (item != NULL) {
-                /* load texture of icon in a new thread */
-                g_thread_create(sbitem_thread_load_texture, item, FALSE, NULL);
+    /* the item is gone if the pages have been reloaded since */
+    if ((job->generation == load_generation) && item->texture) {
+        gui_item_decode(item, job->icon_filename, icon_decode_seq++);
+    }
+    g_free(job);
+
+    return FALSE;
+}
+
+static void sbitem_thread_refresh_texture(gpointer data, gpointer user_data)
+{
+    SBItemJob *job = (SBItemJob *)data;
+    gboolean changed = FALSE;
+    gboolean res = FALSE;
+    GError *err = NULL;
+
+    g_mutex_lock(icon_loader_mutex);
+    if (sbc) {
+        res = device_sbs_refresh_icon(sbc, job->display_identifier, job->icon_filename, &changed, &err);
+    }
+    g_mutex_unlock(icon_loader_mutex);
 
-                *row = g_list_append(*row, item);
-                icon_count++;
+    if (res && changed) {
+        debug_printf("%s: icon for '%s' has changed\n", __func__, job->display_identifier);
+        clutter_threads_add_idle((GSourceFunc)sbitem_texture_reload, job);
+        return;
+    }
+    if (err) {
+        fprintf(stderr, "ERROR: %s\n", err->message);
+        g_error_free(err);
+    }
+    g_free(job);
+}
+
+/* kept icons are checked on icon_refresh_pool, one at a time */
+static void gui_queue_icon_refresh(SBItem *item)
+{
+    if (!sbitem_get_icon_filename(item)) {
+        return;
+    }
+    g_thread_pool_push(icon_refresh_pool, gui_item_job_new(item), NULL);
+}
+
+static gboolean sbitem_icon_is_cached(SBItem *item)
+{
+    const char *icon_filename = sbitem_get_icon_filename(item);
+    gboolean res = FALSE;
+
+    if (icon_filename) {
+        res = g_file_test(icon_filename, G_FILE_TEST_IS_REGULAR);
+    }
+    return res;
+}
+
+static SBItem *gui_reuse_item(SBItem *item)
+{
+    SBItem *old;
+    gboolean stale = FALSE;
+    guint i;
+
+    if (!reuse_items) {
+        return NULL;
+    }
+
+    if (!item->is_folder) {
+        old = g_hash_table_lookup(reuse_items, item->display_identifier);
+        if (!old || (old->page && old->page->folder)) {
+            /* items inside of folders go away with their folder */
+            return NULL;
+        }
+        g_hash_table_remove(reuse_items, item->display_identifier);
+        stale = sbitem_update_icon_mod_date(old, &item->icon_mod_date);
+    } else {
+        old = g_hash_table_lookup(reuse_folders, item->display_name);
+        /* only keep the folder if its contents did not change */
+        if (!old || !iconstate_item_equal(old, item)) {
+            return NULL;
+        }
+        g_hash_table_remove(reuse_folders, item->display_name);
+        for (i = 0; i < old->subitems->count; i++) {
+            if (sbitem_update_icon_mod_date(old->subitems->items[i], &item->subitems->items[i]->icon_mod_date)) {
+                stale = TRUE;
             }
         }
     }
+    /* the value tells whether the cached icon might be outdated */
+    g_hash_table_insert(reused_items, old, GINT_TO_POINTER(stale));
+
+    return old;
+}
+
+static guint gui_load_item_texture(SBItem *item)
+{
+    guint icon_count = 1;
+    guint i;
+
+    item->texture_requested = TRUE;
+    if (item->is_folder) {
+        /* later folder pages are loaded when they are opened */
+        for (i = 0; i < MIN(item->subitems->count, FOLDER_ITEMS); i++) {
+            icon_count += gui_load_item_texture(item->subitems->items[i]);
+        }
+        gui_item_texture_new_later(item);
+    } else if (use_icon_cache && sbitem_icon_is_cached(item)) {
+        /* the icon is already on disk, no need to ask the device */
+        gui_item_texture_new_later(item);
+    } else if (!sbc) {
+        /* the connection is with the fetch thread, see gui_load_deferred_item() */
+        item->texture_deferred = TRUE;
+    } else {
+        /* load texture of icon in a new thread */
+        g_thread_create(sbitem_thread_load_texture, gui_item_job_new(item), FALSE, NULL);
+    }
+
+    return icon_count;
+}
+
+/* starts the loads that had to wait for the device connection */
+static void gui_load_deferred_item(gpointer key, gpointer value, gpointer user_data)
+{
+    SBItem *item = (SBItem*)key;
+    guint i;
+
+    if (item->is_folder) {
+        for (i = 0; i < item->subitems->count; i++) {
+            gui_load_deferred_item(item->subitems->items[i], NULL, NULL);
+        }
+    } else if (item->texture_deferred) {
+        item->texture_deferred = FALSE;
+        g_thread_create(sbitem_thread_load_texture, gui_item_job_new(item), FALSE, NULL);
+    }
+}
+
+static guint gui_load_page(SBPage *page)
+{
+    guint icon_count = 0;
+    guint i;
+
+    for (i = 0; i < page->count; i++) {
+        SBItem *item = page->items[i];
+        SBItem *old = gui_reuse_item(item);
+        if (old) {
+            sbpage_set_item(page, i, old);
+            sbitem_free(item);
+        } else {
+            icon_count += gui_load_item_texture(item);
+        }
+    }
 
     return icon_count;
 }
 
+static void gui_index_page(SBPage *page)
+{
+    guint i;
+
+    for (i = 0; i < page->count; i++) {
+        SBItem *item = page->items[i];
+        if (item->is_folder) {
+            gui_index_page(item->subitems);
+        } else if (item->display_identifier) {
+            g_hash_table_insert(item_index, (gpointer)item->display_identifier, item);
+        }
+    }
+}
+
+/* finds where an app is, its location is in item->page and item->slot */
+SBItem *gui_find_item(const char *display_identifier)
+{
+    return g_hash_table_lookup(item_index, g_intern_string(display_identifier));
+}
+
 static void gui_set_iconstate(plist_t iconstate, const char *format_version)
 {
-    int total;
+    SBIconState state = { NULL, sbpages, 0, 0 };
+    SBIconStateLimits limits;
+    GError *error = NULL;
+    guint i;
 
-    /* get total number of pages */
-    if (plist_get_node_type(iconstate) != PLIST_ARRAY) {
-        fprintf(stderr, "ERROR: Invalid icon state format!\n");
+    if (!iconstate_parse(iconstate, format_version, &state, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error->message);
+        g_error_free(error);
         return;
     }
 
-    total = plist_array_get_size(iconstate);
-    if (total < 1) {
-        fprintf(stderr, "ERROR: No icons returned in icon state\n");
-        return;
-    } else {
-        plist_t dock = plist_array_get_item(iconstate, 0);
-        if ((plist_get_node_type(dock) != PLIST_ARRAY)
-                || (plist_array_get_size(dock) < 1)) {
-            fprintf(stderr, "ERROR: error getting outer dock icon array!\n");
-            return;
+    /* the defaults would move items for good, so this waits for the device */
+    if (device_limits_known) {
+        gui_get_limits(&limits);
+        i = iconstate_normalize(&state, &limits);
+        if (i > 0) {
+            debug_printf("%s: moved %d items to fit the device limits\n", __func__, i);
         }
+    }
 
-        if (!format_version || (strcmp(format_version, "2") != 0)) {
-            dock = plist_array_get_item(dock, 0);
-            if (plist_get_node_type(dock) != PLIST_ARRAY) {
-                fprintf(stderr, "ERROR: error getting inner dock icon array!\n");
-                return;
-            }
+    /* load dock icons */
+    debug_printf("%s: processing dock\n", __func__);
+    dockitems = state.dock;
+    num_dock_items = state.dock_slots;
+    total_icons += gui_load_page(dockitems);
+
+    /* get all page icons */
+    for (i = 0; i < sbpages->len; i++) {
+        debug_printf("%s: processing page %d\n", __func__, i);
+        total_icons += gui_load_page(gui_get_page(i));
+        gui_page_indicator_group_add(gui_get_page(i), i);
+    }
+
+    gui_index_page(dockitems);
+    for (i = 0; i < sbpages->len; i++) {
+        gui_index_page(gui_get_page(i));
+    }
+
+    gui_history_reset();
+}
+
+static void gui_collect_reusable_items(SBPage *items)
+{
+    guint i;
+
+    /* apps are already indexed by item_index */
+    for (i = 0; i < items->count; i++) {
+        SBItem *item = items->items[i];
+        const char *key = sbitem_get_display_name(item);
+        if (item->is_folder && key && !g_hash_table_lookup(reuse_folders, key)) {
+            g_hash_table_insert(reuse_folders, (gpointer)key, item);
+        }
+    }
+}
+
+static void gui_release_unused_items(SBPage *items)
+{
+    guint i;
+
+    for (i = 0; i < items->count; i++) {
+        SBItem *item = items->items[i];
+        if (!g_hash_table_lookup_extended(reused_items, item, NULL, NULL)) {
+            sbitem_free(item);
         }
+    }
+    /* the kept items already moved to the new pages */
+    items->count = 0;
+    sbpage_free(items, FALSE);
+}
 
-        /* load dock icons */
-        debug_printf("%s: processing dock\n", __func__);
-        total_icons += gui_load_icon_row(dock, &dockitems);
-        num_dock_items = g_list_length(dockitems);
-        if (total > 1) {
-            /* get all page icons */
-            int p, r, rows;
-            for (p = 1; p < total; p++) {
-                plist_t npage = plist_array_get_item(iconstate, p);
-                GList *page = NULL;
-                if ((plist_get_node_type(npage) != PLIST_ARRAY)
-                        || (plist_array_get_size(npage) < 1)) {
-                        fprintf(stderr, "ERROR: error getting outer page icon array!\n");
-                        return;
-                }
+static void gui_item_move_to_dock(SBItem *item, gboolean is_dock_item)
+{
+    if (!item || !item->drawn || (item->is_dock_item == is_dock_item)) {
+        return;
+    }
+    clutter_actor_reparent(clutter_actor_get_parent(item->texture), is_dock_item ? the_dock : the_sb);
+    gui_item_set_label(item, label_cache_set_color(label_cache, item->label, is_dock_item ? &dock_item_text_color : &item_text_color));
+    item->is_dock_item = is_dock_item;
+}
 
-                if (!format_version || (strcmp(format_version, "2") != 0)) {
-                    /* rows */
-                    rows = plist_array_get_size(npage);
-                    for (r = 0; r < rows; r++) {
-                        debug_printf("%s: processing page %d, row %d\n", __func__, p, r);
-
-                        plist_t nrow = plist_array_get_item(npage, r);
-                        if (plist_get_node_type(nrow) != PLIST_ARRAY) {
-                            fprintf(stderr, "ERROR: error getting page row icon array!\n");
-                            return;
-                        }
-                        total_icons += gui_load_icon_row(nrow, &page);
-                    }
-                } else {
-                    total_icons += gui_load_icon_row(npage, &page);
-                }
+/* gives an item that was moved out of its folder a group of its own */
+static void gui_item_take_out_of_folder(SBItem *item)
+{
+    ClutterActor *grp;
+    ClutterActor *parent;
 
-                if (page) {
-                        sbpages = g_list_append(sbpages, page);
-                        gui_page_indicator_group_add(page, p - 1);
-                }
+    if (!item || !item->drawn) {
+        return;
+    }
+    grp = clutter_actor_get_parent(item->texture);
+    parent = clutter_actor_get_parent(grp);
+    if ((parent == the_sb) || (parent == the_dock)) {
+        return;
+    }
+    g_signal_handlers_disconnect_by_func(item->texture, G_CALLBACK(subitem_button_press_cb), item);
+    g_signal_handlers_disconnect_by_func(item->texture, G_CALLBACK(subitem_button_release_cb), item);
+    g_signal_connect(item->texture, "button-press-event", G_CALLBACK(item_button_press_cb), item);
+    g_signal_connect(item->texture, "button-release-event", G_CALLBACK(item_button_release_cb), item);
+    clutter_actor_reparent(grp, the_sb);
+    clutter_actor_show(grp);
+    item->is_dock_item = FALSE;
+}
+
+static void gui_refresh_item_icon(gpointer key, gpointer value, gpointer user_data)
+{
+    SBItem *item = (SBItem*)key;
+    guint i;
+
+    if (!GPOINTER_TO_INT(value)) {
+        /* same iconModDate as before, the cached icon is still valid */
+        return;
+    }
+
+    if (item->is_folder) {
+        for (i = 0; i < item->subitems->count; i++) {
+            SBItem *si = item->subitems->items[i];
+            if (si->texture_requested && !si->texture_deferred) {
+                gui_queue_icon_refresh(si);
             }
         }
+    } else if (!item->texture_deferred) {
+        gui_queue_icon_refresh(item);
+    }
+}
+
+static void gui_reconcile_iconstate(plist_t iconstate, const char *format_version)
+{
+    SBPage *old_dock = dockitems;
+    GPtrArray *old_pages = sbpages;
+    guint i, j;
+    gint count;
+
+    /* index what is currently shown so it can be picked up again */
+    reuse_items = item_index;
+    item_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    reuse_folders = g_hash_table_new(g_direct_hash, g_direct_equal);
+    reused_items = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (old_dock) {
+        gui_collect_reusable_items(old_dock);
+    }
+    for (i = 0; i < old_pages->len; i++) {
+        gui_collect_reusable_items((SBPage*)g_ptr_array_index(old_pages, i));
+    }
+
+    dockitems = NULL;
+    sbpages = g_ptr_array_new();
+    clutter_group_remove_all(CLUTTER_GROUP(page_indicator_group));
+
+    /* only items that are new or changed get created here */
+    gui_set_iconstate(iconstate, format_version);
+
+    /* get rid of the items that are gone */
+    if (old_dock) {
+        gui_release_unused_items(old_dock);
+    }
+    for (i = 0; i < old_pages->len; i++) {
+        gui_release_unused_items((SBPage*)g_ptr_array_index(old_pages, i));
+    }
+    g_ptr_array_free(old_pages, TRUE);
+
+    for (i = 0; dockitems && (i < dockitems->count); i++) {
+        gui_item_move_to_dock(dockitems->items[i], TRUE);
+    }
+    for (i = 0; i < sbpages->len; i++) {
+        SBPage *page = gui_get_page(i);
+        for (j = 0; j < page->count; j++) {
+            gui_item_move_to_dock(page->items[j], FALSE);
+        }
     }
+
+    debug_printf("%s: kept %d items\n", __func__, g_hash_table_size(reused_items));
+
+    /* the cached icons of kept items might be outdated, and icons that were
+     * not cached could not be loaded without the connection */
+    if (sbc) {
+        g_hash_table_foreach(reused_items, gui_refresh_item_icon, NULL);
+        g_hash_table_foreach(reused_items, gui_load_deferred_item, NULL);
+    }
+
+    g_hash_table_destroy(reuse_items);
+    reuse_items = NULL;
+    g_hash_table_destroy(reuse_folders);
+    reuse_folders = NULL;
+    g_hash_table_destroy(reused_items);
+    reused_items = NULL;
+
+    gui_show_icons();
+
+    count = sbpages->len;
+    if (current_page >= count) {
+        current_page = MAX(count - 1, 0);
+    }
+    gui_set_current_page(current_page, FALSE);
 }
 
 static void gui_disable_controls()
@@ -1860,12 +3040,48 @@ static void gui_enable_controls()
     gui_fade_stop();
 }
 
+static void gui_count_actors_cb(ClutterActor *actor, gpointer data)
+{
+    guint *count = (guint*)data;
+
+    (*count)++;
+    if (CLUTTER_IS_CONTAINER(actor)) {
+        clutter_container_foreach(CLUTTER_CONTAINER(actor), gui_count_actors_cb, data);
+    }
+}
+
 static gboolean wait_icon_load_finished(gpointer user_data)
 {
     gboolean res = TRUE;
     g_mutex_lock(icon_loader_mutex);
     debug_printf("%d of %d icons loaded (%d%%)\n", icons_loaded, total_icons, (int)(100*((double)icons_loaded/(double)total_icons)));
     if (icons_loaded >= total_icons) {
+        IconDecoderStats stats;
+        icon_decoder_get_stats(icon_decoder, &stats);
+        debug_printf("%s: decoded %d icons (%d failed) and %d reduced levels in %d ms, %d us per icon, %d KB\n", __func__,
+                     stats.decoded, stats.failed, stats.levels, (int)(stats.decode_time / 1000),
+                     (int)(stats.decode_time / MAX(stats.decoded + stats.failed, 1)), (int)(stats.bytes / 1024));
+        debug_printf("%s: uploaded %d icons in %d frames, %d ms total, %d us max per frame, %d frames missed\n", __func__,
+                     upload_stats.uploads, upload_stats.frames, (int)(upload_stats.upload_time / 1000),
+                     (int)upload_stats.max_frame_time, upload_stats.missed_frames);
+        guint actors = 0;
+        gui_count_actors_cb(stage, &actors);
+        debug_printf("%s: %d actors on the stage\n", __func__, actors);
+        LabelCacheStats label_stats;
+        label_cache_get_stats(label_cache, &label_stats);
+        debug_printf("%s: %d labels share %d textures, %d KB, %d cache hits, %d misses\n", __func__,
+                     label_stats.labels, label_stats.textures, (int)(label_stats.bytes / 1024),
+                     label_stats.hits, label_stats.misses);
+#ifdef HAVE_CLUTTER_1_2
+        IconAtlasStats atlas_stats;
+        icon_atlas_get_stats(icon_atlas, &atlas_stats);
+        /* every texture change breaks a batch of rectangles, without the
+         * atlas there would be one texture per icon */
+        debug_printf("%s: %d icons in %d textures (instead of %d), %d KB texture memory (%d KB for separate textures), %d compactions moved %d icons\n", __func__,
+                     atlas_stats.icons, atlas_stats.textures, atlas_stats.icons,
+                     (int)(atlas_stats.bytes / 1024), (int)(atlas_stats.icon_bytes / 1024),
+                     atlas_stats.compactions, atlas_stats.moved);
+#endif
         gui_enable_controls();
         res = FALSE;
         if (finished_callback) {
@@ -1881,7 +3097,14 @@ static gboolean wait_icon_load_finished(gpointer user_data)
 static void gui_set_wallpaper(const char *wp)
 {
     GError *err = NULL;
-    wallpaper = NULL;
+    if (wallpaper) {
+        /* refresh the wallpaper that is already shown */
+        clutter_texture_set_from_file(CLUTTER_TEXTURE(wallpaper), wp, &err);
+        if (err) {
+            g_error_free(err);
+        }
+        return;
+    }
     ClutterActor *actor = clutter_texture_new();
     clutter_texture_set_load_async(CLUTTER_TEXTURE(actor), TRUE);
     clutter_texture_set_from_file(CLUTTER_TEXTURE(actor), wp, &err);
@@ -1900,25 +3123,58 @@ static void gui_set_wallpaper(const char *wp)
 }
 #endif
 
-static gboolean gui_pages_init_cb(gpointer user_data)
+static gboolean gui_pages_update_cb(gpointer user_data)
 {
-    const char *uuid = (const char*)user_data;
-    GError *error = NULL;
-    plist_t iconstate = NULL;
+    SBFetchData *fetch = (SBFetchData*)user_data;
 
-    gui_disable_controls();
-    icons_loaded = 0;
-    total_icons = 0;
+    if (fetch->client) {
+        g_mutex_lock(icon_loader_mutex);
+        if ((fetch->generation == load_generation) && !sbc) {
+            sbc = fetch->client;
+            osversion = fetch->osversion;
+        } else {
+            device_sbs_free(fetch->client);
+        }
+        g_mutex_unlock(icon_loader_mutex);
+        fetch->client = NULL;
+    }
 
-    if (selected_folder) {
-        folderview_close_finish(selected_folder);
+    if (fetch->generation == load_generation) {
+#ifdef HAVE_LIBIMOBILEDEVICE_1_1
+        if (fetch->wallpaper) {
+            gui_set_wallpaper(fetch->wallpaper);
+        }
+#endif
+        if (fetch->iconstate) {
+            if (fetch->warm) {
+                gui_reconcile_iconstate(fetch->iconstate, fetch->format_version);
+            } else {
+                gui_set_iconstate(fetch->iconstate, fetch->format_version);
+            }
+        }
+        clutter_threads_add_timeout(500, (GSourceFunc)wait_icon_load_finished, NULL);
+    } else {
+        debug_printf("%s: discarding outdated icon state\n", __func__);
     }
 
-    pages_free();
+    if (fetch->iconstate) {
+        plist_free(fetch->iconstate);
+    }
+    g_free(fetch->wallpaper);
+    g_free(fetch->uuid);
+    g_free(fetch);
+
+    return FALSE;
+}
+
+static gpointer gui_pages_fetch_cb(gpointer user_data)
+{
+    SBFetchData *fetch = (SBFetchData*)user_data;
+    GError *error = NULL;
 
     /* connect to sbservices */
-    if (!sbc)
-        sbc = device_sbs_new(uuid, &osversion, &error);
+    if (!fetch->client)
+        fetch->client = device_sbs_new(fetch->uuid, &fetch->osversion, &error);
 
     if (error) {
         g_printerr("%s", error->message);
@@ -1926,31 +3182,26 @@ static gboolean gui_pages_init_cb(gpointer user_data)
         error = NULL;
     }
 
-    if (sbc) {
-        const char *fmt_version = NULL;
+    if (fetch->client) {
 #ifdef HAVE_LIBIMOBILEDEVICE_1_1
-        if (osversion >= 0x04000000) {
-            fmt_version = "2";
+        if (fetch->osversion >= 0x04000000) {
+            fetch->format_version = "2";
         }
 
         /* Load wallpaper if available */
-        if (osversion >= 0x03020000) {
-            char *path;
-            path = device_sbs_save_wallpaper(sbc, uuid, &error);
-            if (path == NULL) {
+        if (fetch->osversion >= 0x03020000) {
+            fetch->wallpaper = device_sbs_save_wallpaper(fetch->client, fetch->uuid, &error);
+            if (fetch->wallpaper == NULL && error) {
               g_printerr("%s", error->message);
               g_error_free(error);
               error = NULL;
-	    } else {
-	      gui_set_wallpaper(path);
 	    }
-	    g_free (path);
         }
 #endif
         /* Load icon data */
-        if (device_sbs_get_iconstate(sbc, &iconstate, fmt_version, &error)) {
-            gui_set_iconstate(iconstate, fmt_version);
-            plist_free(iconstate);
+        if (device_sbs_get_iconstate(fetch->client, &fetch->iconstate, fetch->format_version, &error)) {
+            /* remember this layout for the next time the device shows up */
+            device_save_cached_iconstate(fetch->uuid, fetch->iconstate, fetch->format_version, NULL);
         }
     }
 
@@ -1960,7 +3211,69 @@ static gboolean gui_pages_init_cb(gpointer user_data)
         error = NULL;
     }
 
-    clutter_threads_add_timeout(500, (GSourceFunc)wait_icon_load_finished, NULL);
+    /* apply the result in the clutter main loop */
+    clutter_threads_add_idle((GSourceFunc)gui_pages_update_cb, fetch);
+
+    return NULL;
+}
+
+static gboolean gui_pages_init_cb(gpointer user_data)
+{
+    const char *uuid = (const char*)user_data;
+    SBFetchData *fetch = NULL;
+    plist_t iconstate = NULL;
+    char *fmt_version = NULL;
+
+    icons_loaded = 0;
+    total_icons = 0;
+    icon_decoder_reset_stats(icon_decoder);
+    memset(&upload_stats, 0, sizeof(SBUploadStats));
+
+    if (selected_folder) {
+        folderview_close_finish(selected_folder);
+    }
+
+    pages_free();
+
+    fetch = g_new0(SBFetchData, 1);
+    fetch->generation = load_generation;
+    fetch->uuid = g_strdup(uuid);
+
+    /* an existing connection goes to the fetch thread and comes back with it */
+    g_mutex_lock(icon_loader_mutex);
+    fetch->client = sbc;
+    fetch->osversion = osversion;
+    sbc = NULL;
+    osversion = 0;
+    g_mutex_unlock(icon_loader_mutex);
+
+    /* show the layout of the last session right away if we know this device */
+    if (device_load_cached_iconstate(uuid, &iconstate, &fmt_version)) {
+        debug_printf("%s: using cached icon state for %s\n", __func__, uuid);
+#ifdef HAVE_LIBIMOBILEDEVICE_1_1
+        char *path = device_get_cached_wallpaper(uuid);
+        if (path) {
+            gui_set_wallpaper(path);
+            g_free(path);
+        }
+#endif
+        use_icon_cache = TRUE;
+        gui_set_iconstate(iconstate, fmt_version);
+        use_icon_cache = FALSE;
+        plist_free(iconstate);
+        free(fmt_version);
+        fetch->warm = TRUE;
+
+        /* block input until the layout has been checked against the device */
+        clutter_actor_set_reactive(fade_rectangle, TRUE);
+        clutter_actor_raise_top(fade_rectangle);
+        gui_spinner_start();
+    } else {
+        gui_disable_controls();
+    }
+
+    /* get the current state from the device without blocking the stage */
+    g_thread_create((GThreadFunc)gui_pages_fetch_cb, fetch, FALSE, NULL);
 
     return FALSE;
 }
@@ -1969,6 +3282,7 @@ static gboolean update_device_info_cb(gpointer user_data)
 {
     device_info_t di = (device_info_t)user_data;
     if (di) {
+        device_limits_known = TRUE;
         clutter_text_set_text(CLUTTER_TEXT(type_label), di->device_type);
     } else {
         clutter_text_set_text(CLUTTER_TEXT(type_label), NULL);
@@ -2005,11 +3319,13 @@ void gui_pages_free()
 {
     clutter_threads_add_timeout(0, (GSourceFunc)(update_device_info_cb), NULL);
     pages_free();
+    g_mutex_lock(icon_loader_mutex);
     if (sbc) {
         device_sbs_free(sbc);
 	sbc = NULL;
 	osversion = 0;
     }
+    g_mutex_unlock(icon_loader_mutex);
 }
 
 static void gui_update_layout(device_info_t info) {
@@ -2111,6 +3427,7 @@ void gui_pages_load(const char *uuid, device_info_cb_t info_cb, finished_cb_t fi
     printf("%s: %s\n", __func__, uuid);
     finished_callback = finished_cb;
     device_info_callback = info_cb;
+    device_limits_known = FALSE;
 
     /* Load icons */
     clutter_threads_add_idle((GSourceFunc)gui_pages_init_cb, (gpointer)uuid);
@@ -2130,6 +3447,38 @@ GtkWidget *gui_init()
     if (icon_loader_mutex == NULL)
         icon_loader_mutex = g_mutex_new();
 
+    if (sbpages == NULL)
+        sbpages = g_ptr_array_new();
+
+    if (item_index == NULL)
+        item_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (align_pending == NULL)
+        align_pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (resident_pages == NULL)
+        resident_pages = g_queue_new();
+
+    if (undo_history == NULL) {
+        undo_history = g_queue_new();
+        redo_history = g_queue_new();
+    }
+
+    if (item_pool == NULL) {
+        item_pool = sbpool_new(sizeof(SBItem), 64);
+        page_pool = sbpool_new(sizeof(SBPage), 16);
+        slot_pool = sbpool_new(POOL_PAGE_SLOTS * sizeof(SBItem*), 16);
+        sbitem_set_pool(item_pool);
+        sbpage_set_pools(page_pool, slot_pool);
+        sbitem_set_destroy_notify(gui_item_destroy_actors);
+    }
+
+    if (icon_decoder == NULL) {
+        upload_queue = g_async_queue_new();
+        icon_decoder = icon_decoder_new(ICON_DECODE_THREADS, gui_icon_decoded_cb, NULL);
+        icon_refresh_pool = g_thread_pool_new(sbitem_thread_refresh_texture, NULL, 1, FALSE, NULL);
+    }
+
     /* initialize clutter threading environment */
     if (!clutter_threads_initialized) {
         clutter_threads_init();
@@ -2210,6 +3559,8 @@ GtkWidget *gui_init()
         clutter_container_add_actor(CLUTTER_CONTAINER(stage), page_indicator);
     }
 
+    label_cache = label_cache_new(CLUTTER_CONTAINER(stage));
+
     /* icon shadow texture dummy, cloned when drawing the icons */
     icon_shadow = clutter_texture_new();
     clutter_texture_set_load_async(CLUTTER_TEXTURE(icon_shadow), TRUE);
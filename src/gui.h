@@ -29,6 +29,7 @@
 #include <gtk/gtk.h>
 #include <plist/plist.h>
 #include "sbmgr.h"
+#include "sbitem.h"
 
 typedef struct {
     char *uuid;
@@ -40,7 +41,11 @@ void gui_deinit();
 void gui_pages_load(const char *uuid, device_info_cb_t info_callback, finished_cb_t finshed_callback);
 void gui_pages_free();
 
+guint gui_fit_to_device_limits();
 plist_t gui_get_iconstate(const char *format_version);
+const GByteArray *gui_get_iconstate_data(const char *format_version);
+gboolean gui_iconstate_changed(plist_t iconstate, const char *format_version);
 
+SBItem *gui_find_item(const char *display_identifier);
 
 #endif
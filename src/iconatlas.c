@@ -0,0 +1,358 @@
+/**
+ * iconatlas.c
+ * Shared textures for icons
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+ #include <config.h>
+#endif
+
+#include <string.h>
+
+#include "iconatlas.h"
+
+#ifdef HAVE_CLUTTER_1_2
+
+/* icons are all the same size, so every texture is a grid of equal cells;
+ * each cell keeps a transparent border against filtering from neighbours */
+#define ICON_ATLAS_SIZE 1024
+#define ICON_ATLAS_BORDER 1
+
+/* compact when less than half of the allocated cells are in use */
+#define ICON_ATLAS_MIN_FILL 50
+
+typedef struct {
+    CoglHandle texture;
+    guint used;
+    guint next_free;
+    IconAtlasEntry **cells;
+} IconAtlasPage;
+
+struct _IconAtlas {
+    gint cell_width;
+    gint cell_height;
+    gint size;
+    guint columns;
+    guint cells_per_page;
+    GPtrArray *pages;
+    IconAtlasMoveFunc move_func;
+    gpointer user_data;
+    guint icons;
+    guint64 icon_bytes;
+    guint compactions;
+    guint moved;
+};
+
+static IconAtlasPage *icon_atlas_page_new(IconAtlas *atlas)
+{
+    IconAtlasPage *page;
+    guchar *clear;
+
+    page = g_new0(IconAtlasPage, 1);
+    page->cells = g_new0(IconAtlasEntry*, atlas->cells_per_page);
+    page->texture = cogl_texture_new_with_size(atlas->size, atlas->size,
+                                               COGL_TEXTURE_NO_AUTO_MIPMAP,
+                                               COGL_PIXEL_FORMAT_RGBA_8888_PRE);
+
+    /* the borders between the cells have to be transparent */
+    clear = g_malloc0(atlas->size * atlas->size * 4);
+    cogl_texture_set_region(page->texture, 0, 0, 0, 0, atlas->size, atlas->size,
+                            atlas->size, atlas->size, COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                            atlas->size * 4, clear);
+    g_free(clear);
+
+    g_ptr_array_add(atlas->pages, page);
+    return page;
+}
+
+static void icon_atlas_page_free(IconAtlasPage *page)
+{
+    /* entries still drawn keep the texture alive through their sub-texture */
+    cogl_handle_unref(page->texture);
+    g_free(page->cells);
+    g_free(page);
+}
+
+static void icon_atlas_page_remove(IconAtlas *atlas, IconAtlasPage *page)
+{
+    g_ptr_array_remove(atlas->pages, page);
+    icon_atlas_page_free(page);
+}
+
+static guint icon_atlas_page_find_free(IconAtlas *atlas, IconAtlasPage *page)
+{
+    guint i;
+
+    for (i = page->next_free; i < atlas->cells_per_page; i++) {
+        if (!page->cells[i]) {
+            return i;
+        }
+    }
+    for (i = 0; i < page->next_free; i++) {
+        if (!page->cells[i]) {
+            return i;
+        }
+    }
+    return atlas->cells_per_page;
+}
+
+/* uploads the pixels into a free cell of page and points entry at it */
+static void icon_atlas_page_put(IconAtlas *atlas, IconAtlasPage *page, IconAtlasEntry *entry, const guchar *pixels, gint width, gint height, gint rowstride)
+{
+    guint cell = icon_atlas_page_find_free(atlas, page);
+    gint x = (cell % atlas->columns) * atlas->cell_width + ICON_ATLAS_BORDER;
+    gint y = (cell / atlas->columns) * atlas->cell_height + ICON_ATLAS_BORDER;
+
+    cogl_texture_set_region(page->texture, 0, 0, x, y, width, height, width, height,
+                            COGL_PIXEL_FORMAT_RGBA_8888_PRE, rowstride, pixels);
+
+    if (entry->texture) {
+        cogl_handle_unref(entry->texture);
+    }
+    entry->texture = cogl_texture_new_from_sub_texture(page->texture, x, y, width, height);
+    entry->page = page;
+    entry->cell = cell;
+
+    page->cells[cell] = entry;
+    page->used++;
+    page->next_free = cell + 1;
+}
+
+static void icon_atlas_page_take(IconAtlasPage *page, IconAtlasEntry *entry)
+{
+    page->cells[entry->cell] = NULL;
+    page->used--;
+    if (entry->cell < page->next_free) {
+        page->next_free = entry->cell;
+    }
+    entry->page = NULL;
+}
+
+/**
+ * Creates an atlas for icons of at most cell_width x cell_height pixels.
+ * move_func is called for every icon that compaction moved to another
+ * texture, whoever draws it has to pick up the new entry->texture.
+ */
+IconAtlas *icon_atlas_new(gint cell_width, gint cell_height, IconAtlasMoveFunc move_func, gpointer user_data)
+{
+    IconAtlas *atlas = g_new0(IconAtlas, 1);
+
+    atlas->cell_width = cell_width + ICON_ATLAS_BORDER * 2;
+    atlas->cell_height = cell_height + ICON_ATLAS_BORDER * 2;
+    atlas->size = MAX(ICON_ATLAS_SIZE, MAX(atlas->cell_width, atlas->cell_height));
+    atlas->columns = atlas->size / atlas->cell_width;
+    atlas->cells_per_page = atlas->columns * (atlas->size / atlas->cell_height);
+    atlas->pages = g_ptr_array_new();
+    atlas->move_func = move_func;
+    atlas->user_data = user_data;
+
+    return atlas;
+}
+
+/* entries still in use stay valid and can be passed to
+ * icon_atlas_remove() with a NULL atlas later */
+void icon_atlas_free(IconAtlas *atlas)
+{
+    guint i, j;
+
+    if (!atlas) {
+        return;
+    }
+    for (i = 0; i < atlas->pages->len; i++) {
+        IconAtlasPage *page = g_ptr_array_index(atlas->pages, i);
+        for (j = 0; j < atlas->cells_per_page; j++) {
+            if (page->cells[j]) {
+                page->cells[j]->page = NULL;
+            }
+        }
+        icon_atlas_page_free(page);
+    }
+    g_ptr_array_free(atlas->pages, TRUE);
+    g_free(atlas);
+}
+
+/**
+ * Uploads premultiplied RGBA pixels into the first free cell.
+ *
+ * @return the new entry, or NULL when the icon does not fit into a cell
+ *  and needs a texture of its own.
+ */
+IconAtlasEntry *icon_atlas_add(IconAtlas *atlas, const guchar *pixels, gint width, gint height, gint rowstride, gpointer data)
+{
+    IconAtlasPage *page = NULL;
+    IconAtlasEntry *entry;
+    guint i;
+
+    if (!atlas || (width > atlas->cell_width - ICON_ATLAS_BORDER * 2) || (height > atlas->cell_height - ICON_ATLAS_BORDER * 2)) {
+        return NULL;
+    }
+
+    /* filling the first textures up lets the last ones run empty */
+    for (i = 0; i < atlas->pages->len; i++) {
+        IconAtlasPage *p = g_ptr_array_index(atlas->pages, i);
+        if (p->used < atlas->cells_per_page) {
+            page = p;
+            break;
+        }
+    }
+    if (!page) {
+        page = icon_atlas_page_new(atlas);
+        if (page->texture == COGL_INVALID_HANDLE) {
+            icon_atlas_page_remove(atlas, page);
+            return NULL;
+        }
+    }
+
+    entry = g_new0(IconAtlasEntry, 1);
+    entry->data = data;
+    icon_atlas_page_put(atlas, page, entry, pixels, width, height, rowstride);
+    atlas->icons++;
+    atlas->icon_bytes += width * height * 4;
+
+    return entry;
+}
+
+/* gives the cell back, a texture is released as soon as it is empty */
+void icon_atlas_remove(IconAtlas *atlas, IconAtlasEntry *entry)
+{
+    IconAtlasPage *page;
+
+    if (!entry) {
+        return;
+    }
+    page = (IconAtlasPage*)entry->page;
+    if (atlas && page) {
+        icon_atlas_page_take(page, entry);
+        atlas->icons--;
+        atlas->icon_bytes -= cogl_texture_get_width(entry->texture) * cogl_texture_get_height(entry->texture) * 4;
+        if (page->used == 0) {
+            icon_atlas_page_remove(atlas, page);
+        }
+    }
+    if (entry->texture) {
+        cogl_handle_unref(entry->texture);
+    }
+    g_free(entry);
+}
+
+/* TRUE if compaction would free at least one texture and less than
+ * ICON_ATLAS_MIN_FILL percent of the cells are used */
+gboolean icon_atlas_is_fragmented(IconAtlas *atlas)
+{
+    guint needed;
+
+    if (!atlas || atlas->pages->len < 2) {
+        return FALSE;
+    }
+    needed = (atlas->icons + atlas->cells_per_page - 1) / atlas->cells_per_page;
+    if (needed >= atlas->pages->len) {
+        return FALSE;
+    }
+    return (atlas->icons * 100 < atlas->pages->len * atlas->cells_per_page * ICON_ATLAS_MIN_FILL);
+}
+
+static gint icon_atlas_page_compare(gconstpointer a, gconstpointer b)
+{
+    const IconAtlasPage *pa = *(const IconAtlasPage**)a;
+    const IconAtlasPage *pb = *(const IconAtlasPage**)b;
+
+    if (pa->used == pb->used) {
+        return 0;
+    }
+    return (pa->used > pb->used) ? -1 : 1;
+}
+
+/**
+ * Moves the icons of the emptiest textures into the free cells of the
+ * fullest ones, until every texture but the last is full.
+ *
+ * @return the number of icons moved.
+ */
+guint icon_atlas_compact(IconAtlas *atlas)
+{
+    guint moved = 0;
+    guint dst = 0;
+    guint src;
+    guchar *pixels;
+
+    if (!atlas || atlas->pages->len < 2) {
+        return 0;
+    }
+
+    pixels = g_malloc(atlas->cell_width * atlas->cell_height * 4);
+    g_ptr_array_sort(atlas->pages, icon_atlas_page_compare);
+
+    src = atlas->pages->len - 1;
+    while (dst < src) {
+        IconAtlasPage *from = g_ptr_array_index(atlas->pages, src);
+        IconAtlasPage *to = g_ptr_array_index(atlas->pages, dst);
+        IconAtlasEntry *entry = NULL;
+        gint width, height;
+        guint i;
+
+        if (from->used == 0) {
+            icon_atlas_page_remove(atlas, from);
+            src--;
+            continue;
+        }
+        if (to->used == atlas->cells_per_page) {
+            dst++;
+            continue;
+        }
+
+        for (i = 0; i < atlas->cells_per_page && !entry; i++) {
+            entry = from->cells[i];
+        }
+        width = cogl_texture_get_width(entry->texture);
+        height = cogl_texture_get_height(entry->texture);
+        cogl_texture_get_data(entry->texture, COGL_PIXEL_FORMAT_RGBA_8888_PRE, width * 4, pixels);
+
+        icon_atlas_page_take(from, entry);
+        icon_atlas_page_put(atlas, to, entry, pixels, width, height, width * 4);
+        if (atlas->move_func) {
+            atlas->move_func(entry, atlas->user_data);
+        }
+        moved++;
+    }
+    g_free(pixels);
+
+    atlas->compactions++;
+    atlas->moved += moved;
+    return moved;
+}
+
+void icon_atlas_get_stats(IconAtlas *atlas, IconAtlasStats *stats)
+{
+    memset(stats, 0, sizeof(IconAtlasStats));
+    if (!atlas) {
+        return;
+    }
+    stats->textures = atlas->pages->len;
+    stats->icons = atlas->icons;
+    stats->bytes = (guint64)atlas->pages->len * atlas->size * atlas->size * 4;
+    stats->icon_bytes = atlas->icon_bytes;
+    stats->compactions = atlas->compactions;
+    stats->moved = atlas->moved;
+}
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * iconatlas.h
+ * Shared textures for icons
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifndef ICONATLAS_H
+#define ICONATLAS_H
+
+#include <glib.h>
+#include <cogl/cogl.h>
+
+typedef struct _IconAtlas IconAtlas;
+
+/* one icon, drawn from a sub-rectangle of a shared texture */
+typedef struct {
+    CoglHandle texture;
+    gpointer data;
+    gpointer page;
+    guint cell;
+} IconAtlasEntry;
+
+/* called after compaction moved an entry to another texture */
+typedef void (*IconAtlasMoveFunc)(IconAtlasEntry *entry, gpointer user_data);
+
+typedef struct {
+    guint textures;
+    guint icons;
+    guint64 bytes;
+    guint64 icon_bytes;
+    guint compactions;
+    guint moved;
+} IconAtlasStats;
+
+IconAtlas *icon_atlas_new(gint cell_width, gint cell_height, IconAtlasMoveFunc move_func, gpointer user_data);
+void icon_atlas_free(IconAtlas *atlas);
+
+IconAtlasEntry *icon_atlas_add(IconAtlas *atlas, const guchar *pixels, gint width, gint height, gint rowstride, gpointer data);
+void icon_atlas_remove(IconAtlas *atlas, IconAtlasEntry *entry);
+
+gboolean icon_atlas_is_fragmented(IconAtlas *atlas);
+guint icon_atlas_compact(IconAtlas *atlas);
+
+void icon_atlas_get_stats(IconAtlas *atlas, IconAtlasStats *stats);
+
+#endif
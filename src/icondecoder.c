@@ -0,0 +1,263 @@
+/**
+ * icondecoder.c
+ * Icon decoding on worker threads
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+ #include <config.h>
+#endif
+
+#include <string.h>
+#include <sys/time.h>
+
+#include "icondecoder.h"
+
+struct _IconDecoder {
+    GThreadPool *pool;
+    IconDecodeDoneFunc done_func;
+    gpointer user_data;
+    GMutex *stats_mutex;
+    IconDecoderStats stats;
+};
+
+static gint64 icon_decoder_now()
+{
+    GTimeVal tv;
+    g_get_current_time(&tv);
+    return (gint64)tv.tv_sec * G_USEC_PER_SEC + tv.tv_usec;
+}
+
+/* lower priority values are decoded first, equal ones in push order */
+static gint icon_decoder_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const IconDecodeJob *ja = (const IconDecodeJob*)a;
+    const IconDecodeJob *jb = (const IconDecodeJob*)b;
+
+    if (ja->priority == jb->priority) {
+        return 0;
+    }
+    return (ja->priority < jb->priority) ? -1 : 1;
+}
+
+/* what clutter_texture_set_from_rgb_data() with
+ * CLUTTER_TEXTURE_RGB_FLAG_PREMULT expects */
+static void icon_decoder_premultiply(GdkPixbuf *pixbuf)
+{
+    gint width = gdk_pixbuf_get_width(pixbuf);
+    gint height = gdk_pixbuf_get_height(pixbuf);
+    gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+    gint x, y;
+
+    for (y = 0; y < height; y++) {
+        guchar *p = pixels + y * rowstride;
+        for (x = 0; x < width; x++, p += 4) {
+            guint a = p[3];
+            if (a == 255) {
+                continue;
+            }
+            /* x*a/255 rounded, without a division */
+            p[0] = (p[0] * a + 128 + ((p[0] * a + 128) >> 8)) >> 8;
+            p[1] = (p[1] * a + 128 + ((p[1] * a + 128) >> 8)) >> 8;
+            p[2] = (p[2] * a + 128 + ((p[2] * a + 128) >> 8)) >> 8;
+        }
+    }
+}
+
+/* average of four premultiplied RGBA pixels, two channels per 16 bit lane */
+static inline guint32 icon_decoder_average(guint32 a, guint32 b, guint32 c, guint32 d)
+{
+    guint32 even = (a & 0x00ff00ff) + (b & 0x00ff00ff) + (c & 0x00ff00ff) + (d & 0x00ff00ff) + 0x00020002;
+    guint32 odd = ((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff) + ((c >> 8) & 0x00ff00ff) + ((d >> 8) & 0x00ff00ff) + 0x00020002;
+
+    return ((even >> 2) & 0x00ff00ff) | (((odd >> 2) & 0x00ff00ff) << 8);
+}
+
+/* 2x2 box filter, an odd last row or column is averaged with itself */
+static GdkPixbuf *icon_decoder_halve(GdkPixbuf *src)
+{
+    gint width = gdk_pixbuf_get_width(src);
+    gint height = gdk_pixbuf_get_height(src);
+    gint src_stride = gdk_pixbuf_get_rowstride(src);
+    const guchar *src_pixels = gdk_pixbuf_get_pixels(src);
+    GdkPixbuf *dst = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, MAX(width / 2, 1), MAX(height / 2, 1));
+    gint dst_width = gdk_pixbuf_get_width(dst);
+    gint dst_height = gdk_pixbuf_get_height(dst);
+    gint dst_stride = gdk_pixbuf_get_rowstride(dst);
+    guchar *dst_pixels = gdk_pixbuf_get_pixels(dst);
+    gint x, y;
+
+    /* rows of a 32 bit pixbuf are 4 byte aligned */
+    for (y = 0; y < dst_height; y++) {
+        const guint32 *row0 = (const guint32*)(src_pixels + (y * 2) * src_stride);
+        const guint32 *row1 = (const guint32*)(src_pixels + MIN(y * 2 + 1, height - 1) * src_stride);
+        guint32 *out = (guint32*)(dst_pixels + y * dst_stride);
+        for (x = 0; x < dst_width; x++) {
+            gint x1 = MIN(x * 2 + 1, width - 1);
+            out[x] = icon_decoder_average(row0[x * 2], row0[x1], row1[x * 2], row1[x1]);
+        }
+    }
+    return dst;
+}
+
+static void icon_decoder_run(gpointer data, gpointer user_data)
+{
+    IconDecodeJob *job = (IconDecodeJob*)data;
+    IconDecoder *decoder = (IconDecoder*)user_data;
+    gint64 start = icon_decoder_now();
+    GdkPixbuf *pixbuf;
+    guint i;
+
+    pixbuf = gdk_pixbuf_new_from_file_at_size(job->filename, job->width, job->height, &job->error);
+    if (pixbuf) {
+        if (!gdk_pixbuf_get_has_alpha(pixbuf)) {
+            job->pixbuf = gdk_pixbuf_add_alpha(pixbuf, FALSE, 0, 0, 0);
+            g_object_unref(pixbuf);
+        } else {
+            job->pixbuf = pixbuf;
+        }
+        icon_decoder_premultiply(job->pixbuf);
+
+        /* reduced copies for views drawing the icon a lot smaller */
+        pixbuf = job->pixbuf;
+        while ((job->n_levels < ICON_DECODE_MAX_LEVELS) && (job->min_width > 0) && (gdk_pixbuf_get_width(pixbuf) / 2 >= job->min_width)) {
+            pixbuf = icon_decoder_halve(pixbuf);
+            job->levels[job->n_levels++] = pixbuf;
+        }
+    }
+    job->decode_time = icon_decoder_now() - start;
+
+    g_mutex_lock(decoder->stats_mutex);
+    if (job->pixbuf) {
+        decoder->stats.decoded++;
+        decoder->stats.bytes += gdk_pixbuf_get_rowstride(job->pixbuf) * gdk_pixbuf_get_height(job->pixbuf);
+        for (i = 0; i < job->n_levels; i++) {
+            decoder->stats.bytes += gdk_pixbuf_get_rowstride(job->levels[i]) * gdk_pixbuf_get_height(job->levels[i]);
+        }
+        decoder->stats.levels += job->n_levels;
+    } else {
+        decoder->stats.failed++;
+    }
+    decoder->stats.decode_time += job->decode_time;
+    g_mutex_unlock(decoder->stats_mutex);
+
+    decoder->done_func(job, decoder->user_data);
+}
+
+/**
+ * Creates a decoder running the given number of worker threads. Every
+ * finished job is handed to done_func on the worker thread.
+ */
+IconDecoder *icon_decoder_new(guint threads, IconDecodeDoneFunc done_func, gpointer user_data)
+{
+    IconDecoder *decoder = g_new0(IconDecoder, 1);
+
+    decoder->done_func = done_func;
+    decoder->user_data = user_data;
+    decoder->stats_mutex = g_mutex_new();
+    decoder->pool = g_thread_pool_new(icon_decoder_run, decoder, threads, FALSE, NULL);
+    g_thread_pool_set_sort_function(decoder->pool, icon_decoder_compare, NULL);
+
+    return decoder;
+}
+
+/* waits for the queued jobs to finish */
+void icon_decoder_free(IconDecoder *decoder)
+{
+    if (!decoder) {
+        return;
+    }
+    g_thread_pool_free(decoder->pool, FALSE, TRUE);
+    g_mutex_free(decoder->stats_mutex);
+    g_free(decoder);
+}
+
+/**
+ * Queues filename for decoding at width x height. Jobs with a lower
+ * priority value are decoded first.
+ *
+ * @param filename The file to decode, must stay valid until the job is
+ *   done, e.g. an interned string.
+ * @param min_width Reduced levels are made down to this width, 0 for none.
+ * @param data Passed on in the job.
+ */
+void icon_decoder_push(IconDecoder *decoder, const char *filename, gint width, gint height, gint min_width, guint priority, gpointer data)
+{
+    IconDecodeJob *job = g_new0(IconDecodeJob, 1);
+
+    job->filename = filename;
+    job->width = width;
+    job->height = height;
+    job->min_width = min_width;
+    job->priority = priority;
+    job->data = data;
+
+    g_thread_pool_push(decoder->pool, job, NULL);
+}
+
+guint icon_decoder_get_pending(IconDecoder *decoder)
+{
+    return g_thread_pool_unprocessed(decoder->pool);
+}
+
+void icon_decoder_get_stats(IconDecoder *decoder, IconDecoderStats *stats)
+{
+    g_mutex_lock(decoder->stats_mutex);
+    *stats = decoder->stats;
+    g_mutex_unlock(decoder->stats_mutex);
+}
+
+void icon_decoder_reset_stats(IconDecoder *decoder)
+{
+    g_mutex_lock(decoder->stats_mutex);
+    memset(&decoder->stats, 0, sizeof(IconDecoderStats));
+    g_mutex_unlock(decoder->stats_mutex);
+}
+
+/* the smallest level that is still at least width pixels wide */
+GdkPixbuf *icon_decode_job_get_level(IconDecodeJob *job, gint width)
+{
+    GdkPixbuf *pixbuf = job->pixbuf;
+    guint i;
+
+    for (i = 0; i < job->n_levels && gdk_pixbuf_get_width(job->levels[i]) >= width; i++) {
+        pixbuf = job->levels[i];
+    }
+    return pixbuf;
+}
+
+void icon_decode_job_free(IconDecodeJob *job)
+{
+    guint i;
+
+    if (job->pixbuf) {
+        g_object_unref(job->pixbuf);
+    }
+    for (i = 0; i < job->n_levels; i++) {
+        g_object_unref(job->levels[i]);
+    }
+    if (job->error) {
+        g_error_free(job->error);
+    }
+    g_free(job);
+}
@@ -0,0 +1,74 @@
+/**
+ * icondecoder.h
+ * Icon decoding on worker threads (header file)
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifndef ICONDECODER_H
+#define ICONDECODER_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+typedef struct _IconDecoder IconDecoder;
+
+#define ICON_DECODE_MAX_LEVELS 4
+
+/* an icon to decode and, once done, its premultiplied RGBA pixels;
+ * levels[i] is pixbuf reduced by a factor of 2^(i+1) */
+typedef struct {
+    const char *filename;
+    gint width;
+    gint height;
+    gint min_width;
+    guint priority;
+    gpointer data;
+    GdkPixbuf *pixbuf;
+    GdkPixbuf *levels[ICON_DECODE_MAX_LEVELS];
+    guint n_levels;
+    GError *error;
+    gint64 decode_time;
+} IconDecodeJob;
+
+/* called on a worker thread, the callee owns the job */
+typedef void (*IconDecodeDoneFunc)(IconDecodeJob *job, gpointer user_data);
+
+typedef struct {
+    guint decoded;
+    guint failed;
+    guint levels;
+    guint64 bytes;
+    gint64 decode_time;
+} IconDecoderStats;
+
+IconDecoder *icon_decoder_new(guint threads, IconDecodeDoneFunc done_func, gpointer user_data);
+void icon_decoder_free(IconDecoder *decoder);
+
+void icon_decoder_push(IconDecoder *decoder, const char *filename, gint width, gint height, gint min_width, guint priority, gpointer data);
+guint icon_decoder_get_pending(IconDecoder *decoder);
+void icon_decoder_get_stats(IconDecoder *decoder, IconDecoderStats *stats);
+void icon_decoder_reset_stats(IconDecoder *decoder);
+
+GdkPixbuf *icon_decode_job_get_level(IconDecodeJob *job, gint width);
+void icon_decode_job_free(IconDecodeJob *job);
+
+#endif
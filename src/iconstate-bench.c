@@ -0,0 +1,457 @@
+/**
+ * iconstate-bench.c
+ * Synthetic icon state generator and microbenchmarks
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+ #include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <plist/plist.h>
+#include <glib.h>
+
+#include "sbitem.h"
+#include "sbpage.h"
+#include "sbpool.h"
+#include "iconstate.h"
+#include "plistwriter.h"
+
+/*
+ * Builds icon states far bigger than any device would send, from a
+ * fixed seed so numbers are comparable between runs, and measures the
+ * model side of what the gui does with them:
+ *
+ *   parse     - iconstate_parse(), the work gui_set_iconstate() does
+ *               before creating any actors
+ *   write     - iconstate_write_bin(), gui_get_iconstate_data()
+ *   to_plist  - iconstate_to_plist(), the plist tree based serializer
+ *   compare   - iconstate_equal() on two equal layouts
+ *   changed   - parse + compare, what gui_iconstate_changed() does
+ *
+ * Allocations are counted by wrapping the glibc allocator, elsewhere
+ * only the time is reported.
+ */
+
+#define COLUMNS 4
+#define ROWS 4
+#define DOCK_ITEMS 4
+#define FOLDER_ITEMS 12
+#define FOLDER_PAGES 3
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static guint64 alloc_count = 0;
+static guint64 alloc_bytes = 0;
+
+void *malloc(size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += nmemb * size;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+#define HAVE_ALLOC_STATS 1
+#else
+static guint64 alloc_count = 0;
+static guint64 alloc_bytes = 0;
+#endif
+
+typedef struct {
+    const char *format_version;
+    plist_t iconstate;
+    guint items;
+    SBIconState state;
+    SBIconState other;
+    PlistWriter *writer;
+} BenchContext;
+
+typedef void (*BenchFunc)(BenchContext *ctx);
+
+static gint apps = 5000;
+static gint folders = 300;
+static gint iterations = 10;
+static gint seed = 4242;
+static gint format = 0;
+
+static GOptionEntry entries[] = {
+    { "apps", 'a', 0, G_OPTION_ARG_INT, &apps, "Number of apps (default 5000)", "N" },
+    { "folders", 'f', 0, G_OPTION_ARG_INT, &folders, "Number of folders (default 300)", "N" },
+    { "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations, "Runs per measurement (default 10)", "N" },
+    { "seed", 's', 0, G_OPTION_ARG_INT, &seed, "Seed of the generator (default 4242)", "N" },
+    { "format", 0, 0, G_OPTION_ARG_INT, &format, "Only use icon state format 1 or 2", "N" },
+    { NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+/* generator */
+
+static plist_t gen_app(GRand *rng, guint num)
+{
+    plist_t node = plist_new_dict();
+    gchar *str;
+
+    str = g_strdup_printf("com.example.app%05u", num);
+    plist_dict_insert_item(node, "bundleIdentifier", plist_new_string(str));
+    plist_dict_insert_item(node, "displayIdentifier", plist_new_string(str));
+    g_free(str);
+    /* some names need UTF-16 in binary plists */
+    if (g_rand_int_range(rng, 0, 10) == 0) {
+        str = g_strdup_printf("\xc3\x84pp %u", num);
+    } else {
+        str = g_strdup_printf("App %u", num);
+    }
+    plist_dict_insert_item(node, "displayName", plist_new_string(str));
+    g_free(str);
+    plist_dict_insert_item(node, "iconModDate", plist_new_date(g_rand_int_range(rng, 0, 300000000), 0));
+
+    return node;
+}
+
+static plist_t gen_folder(GRand *rng, guint num, guint *app, guint count)
+{
+    plist_t node = plist_new_dict();
+    plist_t iconlists = plist_new_array();
+    plist_t list = NULL;
+    gchar *str;
+    guint i;
+
+    str = g_strdup_printf("Folder %u", num);
+    plist_dict_insert_item(node, "displayName", plist_new_string(str));
+    g_free(str);
+    plist_dict_insert_item(node, "listType", plist_new_string("folder"));
+    for (i = 0; i < count; i++) {
+        if ((i % FOLDER_ITEMS) == 0) {
+            list = plist_new_array();
+            plist_array_append_item(iconlists, list);
+        }
+        plist_array_append_item(list, gen_app(rng, (*app)++));
+    }
+    plist_dict_insert_item(node, "iconLists", iconlists);
+
+    return node;
+}
+
+/* appends node to a format 1 page of rows or a format 2 page list */
+static void gen_page_add(plist_t page, gint fmt, guint slot, plist_t node)
+{
+    plist_t row;
+
+    if (fmt == 2) {
+        plist_array_append_item(plist_array_get_item(page, 0), node);
+        return;
+    }
+    if ((slot % COLUMNS) == 0) {
+        plist_array_append_item(page, plist_new_array());
+    }
+    row = plist_array_get_item(page, slot / COLUMNS);
+    plist_array_append_item(row, node);
+}
+
+static plist_t gen_page_new(gint fmt)
+{
+    plist_t page = plist_new_array();
+    if (fmt == 2) {
+        plist_array_append_item(page, plist_new_array());
+    }
+    return page;
+}
+
+static void gen_page_finish(plist_t page, gint fmt, guint slot)
+{
+    /* format 1 pages are complete grids */
+    while ((fmt == 1) && (slot < COLUMNS*ROWS)) {
+        gen_page_add(page, fmt, slot++, plist_new_bool(0));
+    }
+}
+
+/**
+ * Generates an icon state with the given number of apps, of which a
+ * part is put into the given number of folders, in random order.
+ *
+ * @param count Set to the number of icons (apps and folders) generated.
+ */
+static plist_t gen_iconstate(guint32 gen_seed, gint fmt, guint num_apps, guint num_folders, guint *count)
+{
+    GRand *rng = g_rand_new_with_seed(gen_seed);
+    GPtrArray *nodes = g_ptr_array_new();
+    plist_t iconstate = plist_new_array();
+    plist_t dock = plist_new_array();
+    plist_t page = NULL;
+    guint app = 0;
+    guint i, slot;
+
+    *count = 0;
+    for (i = 0; i < num_folders; i++) {
+        /* most folders have one page, some have more */
+        guint size = g_rand_int_range(rng, 2, FOLDER_ITEMS + 1);
+        if (g_rand_int_range(rng, 0, 8) == 0) {
+            size = g_rand_int_range(rng, 2, FOLDER_ITEMS*FOLDER_PAGES + 1);
+        }
+        if (app + size > num_apps) {
+            break;
+        }
+        g_ptr_array_add(nodes, gen_folder(rng, i, &app, size));
+        *count += size;
+    }
+    while (app < num_apps) {
+        g_ptr_array_add(nodes, gen_app(rng, app++));
+    }
+    *count += nodes->len;
+
+    /* shuffle */
+    for (i = nodes->len; i > 1; i--) {
+        guint j = g_rand_int_range(rng, 0, i);
+        gpointer tmp = g_ptr_array_index(nodes, i - 1);
+        g_ptr_array_index(nodes, i - 1) = g_ptr_array_index(nodes, j);
+        g_ptr_array_index(nodes, j) = tmp;
+    }
+
+    plist_array_append_item(dock, plist_new_array());
+    for (i = 0; (i < DOCK_ITEMS) && (i < nodes->len); i++) {
+        plist_array_append_item(plist_array_get_item(dock, 0), g_ptr_array_index(nodes, i));
+    }
+    plist_array_append_item(iconstate, dock);
+
+    for (slot = 0; i < nodes->len; i++, slot++) {
+        if (slot == COLUMNS*ROWS) {
+            gen_page_finish(page, fmt, slot);
+            page = NULL;
+            slot = 0;
+        }
+        if (!page) {
+            page = gen_page_new(fmt);
+            plist_array_append_item(iconstate, page);
+        }
+        gen_page_add(page, fmt, slot, g_ptr_array_index(nodes, i));
+    }
+    if (page) {
+        gen_page_finish(page, fmt, slot);
+    }
+
+    g_ptr_array_free(nodes, TRUE);
+    g_rand_free(rng);
+
+    return iconstate;
+}
+
+/* benchmarks */
+
+static void bench_parse(BenchContext *ctx)
+{
+    SBIconState state = { NULL, NULL, 0, 0 };
+    iconstate_parse(ctx->iconstate, ctx->format_version, &state, NULL);
+    iconstate_clear(&state);
+}
+
+static void bench_write(BenchContext *ctx)
+{
+    iconstate_write_bin(&ctx->state, ctx->format_version, COLUMNS, ROWS, TRUE, ctx->writer);
+}
+
+static void bench_to_plist(BenchContext *ctx)
+{
+    plist_free(iconstate_to_plist(&ctx->state, ctx->format_version, COLUMNS, ROWS));
+}
+
+static void bench_compare(BenchContext *ctx)
+{
+    if (!iconstate_equal(&ctx->state, &ctx->other)) {
+        fprintf(stderr, "ERROR: equal layouts compare different\n");
+        exit(1);
+    }
+}
+
+static void bench_changed(BenchContext *ctx)
+{
+    SBIconState state = { NULL, NULL, 0, 0 };
+    iconstate_parse(ctx->iconstate, ctx->format_version, &state, NULL);
+    if (!iconstate_equal(&ctx->state, &state)) {
+        fprintf(stderr, "ERROR: equal layouts compare different\n");
+        exit(1);
+    }
+    iconstate_clear(&state);
+}
+
+static guint64 bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (guint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench_run(BenchContext *ctx, const char *name, BenchFunc func)
+{
+    guint64 start, elapsed, allocs, bytes;
+    gint i;
+    double n;
+
+    /* warm up pools and caches */
+    func(ctx);
+
+    allocs = alloc_count;
+    bytes = alloc_bytes;
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        func(ctx);
+    }
+    elapsed = bench_now() - start;
+    allocs = alloc_count - allocs;
+    bytes = alloc_bytes - bytes;
+
+    n = (double)iterations * ctx->items;
+    printf("  %-10s %10.1f ns/item", name, elapsed / n);
+#ifdef HAVE_ALLOC_STATS
+    printf(" %8.3f allocs/item %10.1f bytes/item", allocs / n, bytes / n);
+#endif
+    printf("\n");
+}
+
+/* parses back what was serialized and compares it with the original */
+static gboolean bench_round_trip(BenchContext *ctx)
+{
+    SBIconState state = { NULL, NULL, 0, 0 };
+    plist_t root = NULL;
+    plist_t node;
+    gboolean res;
+
+    iconstate_write_bin(&ctx->state, ctx->format_version, COLUMNS, ROWS, TRUE, ctx->writer);
+    plist_from_bin((const char*)ctx->writer->data->data, ctx->writer->data->len, &root);
+    if (!root) {
+        return FALSE;
+    }
+    res = iconstate_parse(plist_dict_get_item(root, "iconState"), ctx->format_version, &state, NULL) && iconstate_equal(&ctx->state, &state);
+    iconstate_clear(&state);
+    plist_free(root);
+    if (!res) {
+        return FALSE;
+    }
+
+    node = iconstate_to_plist(&ctx->state, ctx->format_version, COLUMNS, ROWS);
+    res = iconstate_parse(node, ctx->format_version, &state, NULL) && iconstate_equal(&ctx->state, &state);
+    iconstate_clear(&state);
+    plist_free(node);
+
+    return res;
+}
+
+static gboolean bench_format(gint fmt)
+{
+    BenchContext ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.format_version = (fmt == 2) ? "2" : "1";
+    ctx.iconstate = gen_iconstate(seed, fmt, apps, folders, &ctx.items);
+    ctx.writer = plistwriter_new();
+    ctx.state.folder_page_items = FOLDER_ITEMS;
+
+    printf("format %d: %d apps, %d folders, %u items, seed %d\n", fmt, apps, folders, ctx.items, seed);
+
+    if (!iconstate_parse(ctx.iconstate, ctx.format_version, &ctx.state, NULL) ||
+        !iconstate_parse(ctx.iconstate, ctx.format_version, &ctx.other, NULL)) {
+        fprintf(stderr, "ERROR: could not parse generated icon state\n");
+        return FALSE;
+    }
+    if (!bench_round_trip(&ctx)) {
+        fprintf(stderr, "ERROR: round trip changed the layout\n");
+        return FALSE;
+    }
+
+    bench_run(&ctx, "parse", bench_parse);
+    bench_run(&ctx, "write", bench_write);
+    bench_run(&ctx, "to_plist", bench_to_plist);
+    bench_run(&ctx, "compare", bench_compare);
+    bench_run(&ctx, "changed", bench_changed);
+
+    iconstate_clear(&ctx.state);
+    iconstate_clear(&ctx.other);
+    plistwriter_free(ctx.writer);
+    plist_free(ctx.iconstate);
+
+    return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    SBPool *item_pool, *page_pool, *slot_pool;
+    gboolean res = TRUE;
+
+    /* count GSlice allocations as well */
+    g_setenv("G_SLICE", "always-malloc", TRUE);
+
+    context = g_option_context_new("- benchmark icon state handling");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    if ((apps < 0) || (folders < 0) || (iterations < 1)) {
+        fprintf(stderr, "ERROR: invalid arguments\n");
+        return 1;
+    }
+
+    /* same setup as the gui */
+    item_pool = sbpool_new(sizeof(SBItem), 64);
+    page_pool = sbpool_new(sizeof(SBPage), 16);
+    slot_pool = sbpool_new(32 * sizeof(SBItem*), 16);
+    sbitem_set_pool(item_pool);
+    sbpage_set_pools(page_pool, slot_pool);
+
+    if (format != 2) {
+        res = bench_format(1) && res;
+    }
+    if (format != 1) {
+        res = bench_format(2) && res;
+    }
+
+    sbitem_set_pool(NULL);
+    sbpage_set_pools(NULL, NULL);
+    sbpool_free(item_pool);
+    sbpool_free(page_pool);
+    sbpool_free(slot_pool);
+
+    return res ? 0 : 1;
+}
@@ -1,6 +1,6 @@
 /**
  * iconstate.c
- * Serialization of iconstate from/to GList's
+ * SpringBoard icon state model
  *
  * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
  * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
@@ -24,48 +24,282 @@
  */
 
 #ifdef HAVE_CONFIG_H
- #include <config.h>
+ #include <config.h> /* for GETTEXT_PACKAGE */
 #endif
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <plist/plist.h>
 #include <glib.h>
+#include <glib/gi18n-lib.h>
 
 #include "iconstate.h"
 
-GList * iconstate_to_g_list(plist_t iconstate, GError **error)
+static GQuark iconstate_domain = 0;
+
+static void iconstate_set_error(GError **error, const char *message)
+{
+    if (!iconstate_domain) {
+        iconstate_domain = g_quark_from_static_string("iconstate");
+    }
+    if (error) {
+        *error = g_error_new(iconstate_domain, EINVAL, "%s", message);
+    }
+}
+
+gint iconstate_get_format(const char *format_version)
+{
+    if (format_version && (strcmp(format_version, "2") == 0)) {
+        return 2;
+    }
+    return 1;
+}
+
+/* format 1 wraps the dock row in another array, format 2 may do so */
+static plist_t iconstate_get_dock_row(plist_t dock)
+{
+    plist_t row = plist_array_get_item(dock, 0);
+    if (row && (plist_get_node_type(row) == PLIST_ARRAY)) {
+        return row;
+    }
+    return dock;
+}
+
+/* format 1 pages consist of rows, format 2 pages are a single list */
+static guint iconstate_get_row_count(plist_t page, gint format)
 {
-    
+    return (format == 2) ? 1 : plist_array_get_size(page);
+}
+
+static plist_t iconstate_get_row(plist_t page, gint format, guint index)
+{
+    if (format == 2) {
+        return iconstate_get_dock_row(page);
+    }
+    return plist_array_get_item(page, index);
+}
+
+gboolean iconstate_validate(plist_t iconstate, const char *format_version, GError **error)
+{
+    gint format = iconstate_get_format(format_version);
+    guint total, p, r;
+    plist_t dock;
+
+    if (!iconstate || (plist_get_node_type(iconstate) != PLIST_ARRAY)) {
+        iconstate_set_error(error, _("Invalid icon state format!"));
+        return FALSE;
+    }
+
+    total = plist_array_get_size(iconstate);
+    if (total < 1) {
+        iconstate_set_error(error, _("No icons returned in icon state"));
+        return FALSE;
+    }
+
+    dock = plist_array_get_item(iconstate, 0);
+    if ((plist_get_node_type(dock) != PLIST_ARRAY) || (plist_array_get_size(dock) < 1)) {
+        iconstate_set_error(error, _("error getting outer dock icon array!"));
+        return FALSE;
+    }
+    if ((format == 1) && (plist_get_node_type(plist_array_get_item(dock, 0)) != PLIST_ARRAY)) {
+        iconstate_set_error(error, _("error getting inner dock icon array!"));
+        return FALSE;
+    }
+
+    for (p = 1; p < total; p++) {
+        plist_t page = plist_array_get_item(iconstate, p);
+        if ((plist_get_node_type(page) != PLIST_ARRAY) || (plist_array_get_size(page) < 1)) {
+            iconstate_set_error(error, _("error getting outer page icon array!"));
+            return FALSE;
+        }
+        for (r = 0; r < iconstate_get_row_count(page, format); r++) {
+            if (plist_get_node_type(iconstate_get_row(page, format, r)) != PLIST_ARRAY) {
+                iconstate_set_error(error, _("error getting page row icon array!"));
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
 }
 
-plist_t g_list_to_iconstate(GList *iconstate, GError **error)
+static void iconstate_parse_row(plist_t row, SBPage *page)
 {
-    plist_t iconstate = NULL;
-    plist_t pdockarray = NULL;
-    plist_t pdockitems = NULL;
     guint i;
+    guint count = plist_array_get_size(row);
 
-    guint count = g_list_length(dockitems);
-    pdockitems = plist_new_array();
     for (i = 0; i < count; i++) {
-        SBItem *item = g_list_nth_data(dockitems, i);
-        if (!item) {
+        plist_t icon_info = plist_array_get_item(row, i);
+        plist_t iconlists;
+        SBItem *item = NULL;
+
+        if (plist_get_node_type(icon_info) != PLIST_DICT) {
+            /* empty slot */
             continue;
         }
-        plist_t valuenode = plist_dict_get_item(item->node, "displayIdentifier");
-        if (!valuenode) {
-            printf("could not get displayIdentifier\n");
-            continue;
+        iconlists = plist_dict_get_item(icon_info, "iconLists");
+        if (iconlists) {
+            /* this is a folder, its pages are kept as one list */
+            guint pages = 0;
+            guint capacity = 0;
+            guint p;
+            if (plist_get_node_type(iconlists) == PLIST_ARRAY) {
+                pages = plist_array_get_size(iconlists);
+            }
+            for (p = 0; p < pages; p++) {
+                plist_t subitems = plist_array_get_item(iconlists, p);
+                if (plist_get_node_type(subitems) == PLIST_ARRAY) {
+                    capacity += plist_array_get_size(subitems);
+                }
+            }
+            if (capacity > 0) {
+                SBPage *folderitems = sbpage_new(capacity);
+                for (p = 0; p < pages; p++) {
+                    plist_t subitems = plist_array_get_item(iconlists, p);
+                    if (plist_get_node_type(subitems) == PLIST_ARRAY) {
+                        iconstate_parse_row(subitems, folderitems);
+                    }
+                }
+                if (folderitems->count > 0) {
+                    item = sbitem_new_with_subitems(icon_info, folderitems);
+                }
+                if (!item) {
+                    sbpage_free(folderitems, TRUE);
+                }
+            }
+        } else {
+            item = sbitem_new(icon_info);
+        }
+        if (item) {
+            sbpage_append_item(page, item);
+        }
+    }
+}
+
+/**
+ * Builds the layout described by iconstate. The dock is stored in
+ * state->dock, non-empty pages are appended to state->pages, which is
+ * created if it is NULL.
+ */
+gboolean iconstate_parse(plist_t iconstate, const char *format_version, SBIconState *state, GError **error)
+{
+    gint format = iconstate_get_format(format_version);
+    guint total, p, r;
+    plist_t row;
+
+    if (!iconstate_validate(iconstate, format_version, error)) {
+        return FALSE;
+    }
+
+    row = iconstate_get_dock_row(plist_array_get_item(iconstate, 0));
+    state->dock = sbpage_new(plist_array_get_size(row));
+    iconstate_parse_row(row, state->dock);
+    state->dock_slots = state->dock->count;
+
+    if (!state->pages) {
+        state->pages = g_ptr_array_new();
+    }
+
+    total = plist_array_get_size(iconstate);
+    for (p = 1; p < total; p++) {
+        plist_t npage = plist_array_get_item(iconstate, p);
+        guint rows = iconstate_get_row_count(npage, format);
+        guint capacity = 0;
+        SBPage *page;
+
+        for (r = 0; r < rows; r++) {
+            capacity += plist_array_get_size(iconstate_get_row(npage, format, r));
+        }
+        page = sbpage_new(capacity);
+        for (r = 0; r < rows; r++) {
+            iconstate_parse_row(iconstate_get_row(npage, format, r), page);
+        }
+        if (page->count > 0) {
+            page->index = state->pages->len;
+            g_ptr_array_add(state->pages, page);
+        } else {
+            sbpage_free(page, FALSE);
         }
+    }
+
+    return TRUE;
+}
+
+/* number of iconLists entries needed for count folder items */
+static guint iconstate_folder_page_count(guint count, guint page_items)
+{
+    if ((page_items == 0) || (count == 0)) {
+        return 1;
+    }
+    return (count + page_items - 1) / page_items;
+}
+
+static plist_t iconstate_item_to_plist(SBItem *item, guint folder_page_items)
+{
+    plist_t result = sbitem_get_node(item);
+
+    if (item->is_folder) {
+        plist_t iconlists = plist_new_array();
+        plist_t subitems = NULL;
+        guint i;
+
+        for (i = 0; i < item->subitems->count; i++) {
+            if (!subitems || ((folder_page_items > 0) && ((i % folder_page_items) == 0))) {
+                subitems = plist_new_array();
+                plist_array_append_item(iconlists, subitems);
+            }
+            plist_array_append_item(subitems, sbitem_get_node(item->subitems->items[i]));
+        }
+        if (!subitems) {
+            plist_array_append_item(iconlists, plist_new_array());
+        }
+        plist_dict_insert_item(result, "iconLists", iconlists);
+    }
+    return result;
+}
 
-        plist_t pitem = plist_new_dict();
-        plist_dict_insert_item(pitem, "displayIdentifier", plist_copy(valuenode));
-        plist_array_append_item(pdockitems, pitem);
+/**
+ * Whether every page of state fits into a columns x rows grid, the
+ * serializers only write that many slots per page.
+ */
+gboolean iconstate_fits_grid(SBIconState *state, guint columns, guint rows)
+{
+    guint i;
+
+    for (i = 0; state->pages && (i < state->pages->len); i++) {
+        SBPage *page = (SBPage*)g_ptr_array_index(state->pages, i);
+        if (page->count > columns*rows) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * Serializes state in the given format. Format 1 pages are written as
+ * rows x columns grids with empty slots set to false. Folders are split
+ * into pages of state->folder_page_items items.
+ */
+plist_t iconstate_to_plist(SBIconState *state, const char *format_version, guint columns, guint rows)
+{
+    gint format = iconstate_get_format(format_version);
+    plist_t iconstate;
+    plist_t pdockarray;
+    plist_t pdockitems;
+    guint count;
+    guint i, j;
+
+    count = state->dock ? state->dock->count : 0;
+    pdockitems = plist_new_array();
+    for (i = 0; i < count; i++) {
+        plist_array_append_item(pdockitems, iconstate_item_to_plist(state->dock->items[i], state->folder_page_items));
     }
-    for (i = count; i < num_dock_items; i++) {
-        plist_array_append_item(pdockitems, plist_new_bool(0));
+    if (format == 1) {
+        for (i = count; i < state->dock_slots; i++) {
+            plist_array_append_item(pdockitems, plist_new_bool(0));
+        }
     }
     pdockarray = plist_new_array();
     plist_array_append_item(pdockarray, pdockitems);
@@ -73,41 +307,440 @@ plist_t g_list_to_iconstate(GList *iconstate, GError **error)
     iconstate = plist_new_array();
     plist_array_append_item(iconstate, pdockarray);
 
-    for (i = 0; i < g_list_length(sbpages); i++) {
-        GList *page = g_list_nth_data(sbpages, i);
-        if (page) {
-            guint j;
-            count = g_list_length(page);
-            if (count <= 0) {
-                continue;
+    for (i = 0; state->pages && (i < state->pages->len); i++) {
+        SBPage *page = (SBPage*)g_ptr_array_index(state->pages, i);
+        plist_t ppage;
+        plist_t row = NULL;
+
+        if (!page || (page->count == 0)) {
+            continue;
+        }
+        ppage = plist_new_array();
+        if (format == 2) {
+            row = plist_new_array();
+            plist_array_append_item(ppage, row);
+        }
+        for (j = 0; j < columns*rows; j++) {
+            SBItem *item = sbpage_get_item(page, j);
+            if ((format == 1) && ((j % columns) == 0)) {
+                row = plist_new_array();
+                plist_array_append_item(ppage, row);
+            }
+            if (item) {
+                plist_array_append_item(row, iconstate_item_to_plist(item, state->folder_page_items));
+            } else if (format == 1) {
+                plist_array_append_item(row, plist_new_bool(0));
             }
-            plist_t ppage = plist_new_array();
-            plist_t row = NULL;
-            for (j = 0; j < 16; j++) {
-                SBItem *item = g_list_nth_data(page, j);
-                if ((j % 4) == 0) {
-                    row = plist_new_array();
-                    plist_array_append_item(ppage, row);
+        }
+        plist_array_append_item(iconstate, ppage);
+    }
+
+    return iconstate;
+}
+
+static gboolean iconstate_write_item(PlistWriter *writer, SBItem *item, guint folder_page_items, guint *index)
+{
+    guint32 extra_length = 0;
+    const char *extra_data = sbitem_get_extra(item, &extra_length);
+    guint extra = extra_data ? plistwriter_get_dict_size(extra_data, extra_length) : 0;
+    guint count = extra;
+    guint slot = extra;
+    guint refs;
+    gboolean res = TRUE;
+
+    count += (item->display_identifier ? 1 : 0) + (item->display_name ? 1 : 0);
+    count += ((item->icon_mod_date.tv_sec != 0) ? 1 : 0) + (item->is_folder ? 1 : 0);
+
+    /* same key order as sbitem_get_node() */
+    *index = plistwriter_begin_dict(writer, count, &refs);
+    if (extra > 0) {
+        res = plistwriter_copy_dict_entries(writer, extra_data, extra_length, refs, count, 0);
+    }
+    if (item->display_identifier) {
+        guint key = plistwriter_add_string(writer, "displayIdentifier");
+        plistwriter_set_dict_entry(writer, refs, count, slot++, key, plistwriter_add_string(writer, item->display_identifier));
+    }
+    if (item->display_name) {
+        guint key = plistwriter_add_string(writer, "displayName");
+        plistwriter_set_dict_entry(writer, refs, count, slot++, key, plistwriter_add_string(writer, item->display_name));
+    }
+    if (item->icon_mod_date.tv_sec != 0) {
+        guint key = plistwriter_add_string(writer, "iconModDate");
+        plistwriter_set_dict_entry(writer, refs, count, slot++, key, plistwriter_add_date(writer, item->icon_mod_date.tv_sec, item->icon_mod_date.tv_usec));
+    }
+    if (item->is_folder) {
+        guint key = plistwriter_add_string(writer, "iconLists");
+        guint total = item->subitems->count;
+        guint pages = iconstate_folder_page_count(total, folder_page_items);
+        guint per_page = (pages > 1) ? folder_page_items : total;
+        guint lists_refs, list_refs, list, subitem, i, p;
+        guint lists = plistwriter_begin_array(writer, pages, &lists_refs);
+
+        for (p = 0; p < pages; p++) {
+            guint first = p * per_page;
+            guint n = MIN(per_page, total - first);
+            list = plistwriter_begin_array(writer, n, &list_refs);
+            for (i = 0; i < n; i++) {
+                if (!iconstate_write_item(writer, item->subitems->items[first + i], folder_page_items, &subitem)) {
+                    res = FALSE;
                 }
-                if (item && item->node) {
-                    plist_t valuenode = plist_dict_get_item(item->node,
-                                                            "displayIdentifier");
-                    if (!valuenode) {
-                        printf("could not get displayIdentifier\n");
-                        continue;
-                    }
+                plistwriter_set_ref(writer, list_refs, i, subitem);
+            }
+            plistwriter_set_ref(writer, lists_refs, p, list);
+        }
+        plistwriter_set_dict_entry(writer, refs, count, slot++, key, lists);
+    }
+    return res;
+}
+
+/* writes a slot of a format 1 grid, false if it is empty */
+static gboolean iconstate_write_slot(PlistWriter *writer, SBPage *page, guint slot, guint folder_page_items, guint *index)
+{
+    SBItem *item = sbpage_get_item(page, slot);
 
-                    plist_t pitem = plist_new_dict();
-                    plist_dict_insert_item(pitem, "displayIdentifier", plist_copy(valuenode));
-                    plist_array_append_item(row, pitem);
-                } else {
-                    plist_array_append_item(row, plist_new_bool(0));
+    if (!item) {
+        *index = plistwriter_add_bool(writer, FALSE);
+        return TRUE;
+    }
+    return iconstate_write_item(writer, item, folder_page_items, index);
+}
+
+/**
+ * Serializes state like iconstate_to_plist(), but straight into the
+ * binary plist buffer of writer, without building a plist tree. With
+ * envelope set the result is the dict kept in the icon state cache,
+ * holding formatVersion and iconState.
+ *
+ * Returns FALSE without writing anything if a page holds more than
+ * columns x rows items, those would be lost otherwise.
+ */
+gboolean iconstate_write_bin(SBIconState *state, const char *format_version, guint columns, guint rows, gboolean envelope, PlistWriter *writer)
+{
+    gint format = iconstate_get_format(format_version);
+    guint page_count = 0;
+    guint dock_count = state->dock ? state->dock->count : 0;
+    guint dock_slots = dock_count;
+    guint root_refs, dock, dock_refs, row, row_refs, page_refs, index;
+    guint i, j, p;
+    gboolean res = TRUE;
+
+    if (!iconstate_fits_grid(state, columns, rows)) {
+        return FALSE;
+    }
+    for (i = 0; state->pages && (i < state->pages->len); i++) {
+        SBPage *page = (SBPage*)g_ptr_array_index(state->pages, i);
+        if (page->count > 0) {
+            page_count++;
+        }
+    }
+    if (format == 1) {
+        dock_slots = MAX(dock_count, state->dock_slots);
+    }
+
+    plistwriter_begin(writer);
+    if (envelope) {
+        guint envelope_refs, key;
+        plistwriter_begin_dict(writer, 2, &envelope_refs);
+        key = plistwriter_add_string(writer, "formatVersion");
+        plistwriter_set_dict_entry(writer, envelope_refs, 2, 0, key, plistwriter_add_string(writer, (format == 2) ? "2" : "1"));
+        key = plistwriter_add_string(writer, "iconState");
+        plistwriter_set_dict_entry(writer, envelope_refs, 2, 1, key, writer->offsets->len);
+    }
+    plistwriter_begin_array(writer, 1 + page_count, &root_refs);
+
+    dock = plistwriter_begin_array(writer, 1, &dock_refs);
+    row = plistwriter_begin_array(writer, dock_slots, &row_refs);
+    for (i = 0; i < dock_slots; i++) {
+        if (!iconstate_write_slot(writer, state->dock, i, state->folder_page_items, &index)) {
+            res = FALSE;
+        }
+        plistwriter_set_ref(writer, row_refs, i, index);
+    }
+    plistwriter_set_ref(writer, dock_refs, 0, row);
+    plistwriter_set_ref(writer, root_refs, 0, dock);
+
+    for (i = 0, p = 1; state->pages && (i < state->pages->len); i++) {
+        SBPage *page = (SBPage*)g_ptr_array_index(state->pages, i);
+        guint ppage;
+
+        if (page->count == 0) {
+            continue;
+        }
+        if (format == 2) {
+            ppage = plistwriter_begin_array(writer, 1, &page_refs);
+            row = plistwriter_begin_array(writer, page->count, &row_refs);
+            for (j = 0; j < page->count; j++) {
+                if (!iconstate_write_item(writer, page->items[j], state->folder_page_items, &index)) {
+                    res = FALSE;
+                }
+                plistwriter_set_ref(writer, row_refs, j, index);
+            }
+            plistwriter_set_ref(writer, page_refs, 0, row);
+        } else {
+            guint r, c;
+            ppage = plistwriter_begin_array(writer, rows, &page_refs);
+            for (r = 0; r < rows; r++) {
+                row = plistwriter_begin_array(writer, columns, &row_refs);
+                for (c = 0; c < columns; c++) {
+                    if (!iconstate_write_slot(writer, page, r*columns + c, state->folder_page_items, &index)) {
+                        res = FALSE;
+                    }
+                    plistwriter_set_ref(writer, row_refs, c, index);
                 }
+                plistwriter_set_ref(writer, page_refs, r, row);
             }
-            plist_array_append_item(iconstate, plist_copy(ppage));
-            plist_free(ppage);
         }
+        plistwriter_set_ref(writer, root_refs, p++, ppage);
     }
+    plistwriter_end(writer);
 
-    return iconstate;
+    return res;
+}
+
+plist_t iconstate_convert(plist_t iconstate, const char *from_version, const char *to_version, guint columns, guint rows, GError **error)
+{
+    SBIconState state = { NULL, NULL, 0, 0 };
+    plist_t result = NULL;
+
+    if (iconstate_parse(iconstate, from_version, &state, error)) {
+        result = iconstate_to_plist(&state, to_version, columns, rows);
+    }
+    iconstate_clear(&state);
+
+    return result;
+}
+
+/* identifiers and names are interned, so comparing pointers is enough */
+gboolean iconstate_item_equal(SBItem *a, SBItem *b)
+{
+    guint i;
+
+    if (a == b) {
+        return TRUE;
+    }
+    if (!a || !b || (a->is_folder != b->is_folder)) {
+        return FALSE;
+    }
+    if (!a->is_folder) {
+        return (a->display_identifier == b->display_identifier);
+    }
+    if ((a->display_name != b->display_name) || (a->subitems->count != b->subitems->count)) {
+        return FALSE;
+    }
+    for (i = 0; i < a->subitems->count; i++) {
+        if (!iconstate_item_equal(a->subitems->items[i], b->subitems->items[i])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean iconstate_page_equal(SBPage *a, SBPage *b)
+{
+    guint i;
+    guint count_a = a ? a->count : 0;
+    guint count_b = b ? b->count : 0;
+
+    if (count_a != count_b) {
+        return FALSE;
+    }
+    for (i = 0; i < count_a; i++) {
+        if (!iconstate_item_equal(a->items[i], b->items[i])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+gboolean iconstate_equal(SBIconState *a, SBIconState *b)
+{
+    guint i, pa = 0, pb = 0;
+    guint len_a = a->pages ? a->pages->len : 0;
+    guint len_b = b->pages ? b->pages->len : 0;
+
+    if (!iconstate_page_equal(a->dock, b->dock)) {
+        return FALSE;
+    }
+    /* empty pages are not part of the layout */
+    for (i = 0; i < MAX(len_a, len_b); i++) {
+        SBPage *page_a = NULL;
+        SBPage *page_b = NULL;
+        while ((pa < len_a) && !(page_a = g_ptr_array_index(a->pages, pa++))->count) {
+            page_a = NULL;
+        }
+        while ((pb < len_b) && !(page_b = g_ptr_array_index(b->pages, pb++))->count) {
+            page_b = NULL;
+        }
+        if (!iconstate_page_equal(page_a, page_b)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static guint iconstate_folder_capacity(const SBIconStateLimits *limits)
+{
+    return limits->folder_page_items * limits->folder_pages;
+}
+
+static gboolean iconstate_check_page(SBPage *page, guint capacity, const SBIconStateLimits *limits)
+{
+    guint i, j;
+
+    if (page->count > capacity) {
+        return FALSE;
+    }
+    for (i = 0; i < page->count; i++) {
+        SBItem *item = page->items[i];
+        if (!item->is_folder) {
+            continue;
+        }
+        if (item->subitems->count > iconstate_folder_capacity(limits)) {
+            return FALSE;
+        }
+        for (j = 0; j < item->subitems->count; j++) {
+            if (item->subitems->items[j]->is_folder) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * Checks in one pass over all items if state fits into the limits of
+ * the device: the number of items in the dock, on a page and in a
+ * folder, and no folders inside of folders.
+ */
+gboolean iconstate_check(SBIconState *state, const SBIconStateLimits *limits)
+{
+    guint i;
+
+    if (state->dock && !iconstate_check_page(state->dock, limits->dock_items, limits)) {
+        return FALSE;
+    }
+    if (state->dock_slots > limits->dock_items) {
+        return FALSE;
+    }
+    for (i = 0; state->pages && (i < state->pages->len); i++) {
+        if (!iconstate_check_page(g_ptr_array_index(state->pages, i), limits->page_items, limits)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* takes nested folders and what does not fit out of folder and adds it to spill */
+static void iconstate_normalize_folder(SBItem *item, const SBIconStateLimits *limits, GPtrArray *spill)
+{
+    guint folder_capacity = iconstate_folder_capacity(limits);
+    guint j;
+
+    if (!item->is_folder || !item->subitems) {
+        return;
+    }
+    for (j = 0; j < item->subitems->count; ) {
+        if (item->subitems->items[j]->is_folder) {
+            g_ptr_array_add(spill, sbpage_remove_index(item->subitems, j));
+        } else {
+            j++;
+        }
+    }
+    while (item->subitems->count > folder_capacity) {
+        g_ptr_array_add(spill, sbpage_remove_index(item->subitems, folder_capacity));
+    }
+}
+
+/* takes what does not fit out of page and its folders and adds it to spill */
+static void iconstate_normalize_page(SBPage *page, guint capacity, const SBIconStateLimits *limits, GPtrArray *spill)
+{
+    guint i;
+
+    for (i = 0; i < page->count; i++) {
+        iconstate_normalize_folder(page->items[i], limits, spill);
+    }
+    while (page->count > capacity) {
+        g_ptr_array_add(spill, sbpage_remove_index(page, capacity));
+    }
+}
+
+/**
+ * Makes state fit into the limits of the device, see iconstate_check().
+ * Only the items that do not fit are moved: they are taken out of the
+ * dock, the pages and the folders they overflow and put into the first
+ * free slots on the pages, new pages are added at the end if needed.
+ * Empty pages are removed.
+ *
+ * @return The number of items that were moved.
+ */
+guint iconstate_normalize(SBIconState *state, const SBIconStateLimits *limits)
+{
+    GPtrArray *spill;
+    guint moved, i, p;
+
+    if (limits->page_items == 0) {
+        /* nowhere to put anything */
+        return 0;
+    }
+
+    spill = g_ptr_array_new();
+    if (!state->pages) {
+        state->pages = g_ptr_array_new();
+    }
+
+    if (state->dock) {
+        iconstate_normalize_page(state->dock, limits->dock_items, limits, spill);
+    }
+    state->dock_slots = MIN(state->dock_slots, limits->dock_items);
+    for (i = 0; i < state->pages->len; i++) {
+        iconstate_normalize_page(g_ptr_array_index(state->pages, i), limits->page_items, limits, spill);
+    }
+    /* spilled folders can hold folders or too many items themselves,
+     * what they give up is appended and gets its turn as well */
+    for (i = 0; i < spill->len; i++) {
+        iconstate_normalize_folder(g_ptr_array_index(spill, i), limits, spill);
+    }
+    moved = spill->len;
+
+    /* fill up the pages from the front, the spilled items fit anywhere now */
+    for (i = 0, p = 0; i < spill->len; i++) {
+        SBPage *page = NULL;
+        while ((p < state->pages->len) && ((page = g_ptr_array_index(state->pages, p))->count >= limits->page_items)) {
+            page = NULL;
+            p++;
+        }
+        if (!page) {
+            page = sbpage_new(limits->page_items);
+            g_ptr_array_add(state->pages, page);
+        }
+        sbpage_append_item(page, g_ptr_array_index(spill, i));
+    }
+    g_ptr_array_free(spill, TRUE);
+
+    for (i = 0, p = 0; i < state->pages->len; i++) {
+        SBPage *page = g_ptr_array_index(state->pages, i);
+        if (page->count == 0) {
+            sbpage_free(page, FALSE);
+            continue;
+        }
+        page->index = p;
+        g_ptr_array_index(state->pages, p++) = page;
+    }
+    g_ptr_array_set_size(state->pages, p);
+
+    return moved;
+}
+
+void iconstate_clear(SBIconState *state)
+{
+    if (state->dock) {
+        sbpage_free(state->dock, TRUE);
+        state->dock = NULL;
+    }
+    if (state->pages) {
+        g_ptr_array_foreach(state->pages, (GFunc)(g_func_sbpage_free), NULL);
+        g_ptr_array_free(state->pages, TRUE);
+        state->pages = NULL;
+    }
+    state->dock_slots = 0;
 }
@@ -1,6 +1,6 @@
 /**
  * iconstate.h
- * Serialization of iconstate from/to GList's (header file)
+ * SpringBoard icon state model (header file)
  *
  * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
  * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
@@ -26,15 +26,45 @@
 #ifndef ICONSTATE_H
 #define ICONSTATE_H
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <plist/plist.h>
 #include <glib.h>
+#include <plist/plist.h>
+
+#include "sbitem.h"
+#include "sbpage.h"
+#include "plistwriter.h"
+
+/* the home screen layout: dock plus a list of SBPage's */
+typedef struct {
+    SBPage *dock;
+    GPtrArray *pages;
+    guint dock_slots;
+    /* folders are written in pages of this many items, 0 for one page */
+    guint folder_page_items;
+} SBIconState;
+
+/* what the device accepts, see device_info_t */
+typedef struct {
+    guint dock_items;
+    guint page_items;
+    guint folder_page_items;
+    guint folder_pages;
+} SBIconStateLimits;
+
+gint iconstate_get_format(const char *format_version);
+
+gboolean iconstate_validate(plist_t iconstate, const char *format_version, GError **error);
+gboolean iconstate_parse(plist_t iconstate, const char *format_version, SBIconState *state, GError **error);
+gboolean iconstate_fits_grid(SBIconState *state, guint columns, guint rows);
+plist_t iconstate_to_plist(SBIconState *state, const char *format_version, guint columns, guint rows);
+gboolean iconstate_write_bin(SBIconState *state, const char *format_version, guint columns, guint rows, gboolean envelope, PlistWriter *writer);
+plist_t iconstate_convert(plist_t iconstate, const char *from_version, const char *to_version, guint columns, guint rows, GError **error);
+
+gboolean iconstate_item_equal(SBItem *a, SBItem *b);
+gboolean iconstate_equal(SBIconState *a, SBIconState *b);
 
-#include "iconstate.h"
+gboolean iconstate_check(SBIconState *state, const SBIconStateLimits *limits);
+guint iconstate_normalize(SBIconState *state, const SBIconStateLimits *limits);
 
-GList * iconstate_to_g_list(plist_t iconstate, GError **error);
-plist_t g_list_to_iconstate(GList *iconstate, GError **error);
+void iconstate_clear(SBIconState *state);
 
 #endif
@@ -0,0 +1,238 @@
+/**
+ * labelcache.c
+ * Pre-rendered icon labels
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+ #include <config.h>
+#endif
+
+#include <string.h>
+#include <pango/pangocairo.h>
+
+#include "labelcache.h"
+
+/* the shadow is drawn one pixel down and right of the text */
+#define LABEL_SHADOW_OFFSET 1
+
+typedef struct {
+    char *key;
+    char *text;
+    char *font;
+    ClutterColor color;
+    ClutterColor shadow_color;
+    gboolean has_shadow;
+    ClutterActor *texture;
+    guint ref_count;
+} LabelCacheEntry;
+
+struct _LabelCache {
+    ClutterContainer *container;
+    GHashTable *entries;
+    PangoContext *context;
+    PangoLayout *layout;
+    guint labels;
+    guint64 bytes;
+    guint hits;
+    guint misses;
+};
+
+static char *label_cache_key(const char *text, const char *font, const ClutterColor *color, const ClutterColor *shadow_color)
+{
+    return g_strdup_printf("%s\n%08x\n%08x\n%s", font, clutter_color_to_pixel(color),
+                           shadow_color ? clutter_color_to_pixel(shadow_color) : 0, text);
+}
+
+/* rasterizes text once, the shadow and the text go into the same texture */
+static void label_cache_render(LabelCache *cache, LabelCacheEntry *entry)
+{
+    PangoFontDescription *desc = pango_font_description_from_string(entry->font);
+    gint offset = entry->has_shadow ? LABEL_SHADOW_OFFSET : 0;
+    gint width, height;
+    cairo_t *cr;
+
+    pango_layout_set_font_description(cache->layout, desc);
+    pango_font_description_free(desc);
+    pango_layout_set_text(cache->layout, entry->text, -1);
+    pango_layout_get_pixel_size(cache->layout, &width, &height);
+    width = MAX(width + offset, 1);
+    height = MAX(height + offset, 1);
+
+    entry->texture = clutter_cairo_texture_new(width, height);
+    cr = clutter_cairo_texture_create(CLUTTER_CAIRO_TEXTURE(entry->texture));
+    pango_cairo_update_layout(cr, cache->layout);
+    if (entry->has_shadow) {
+        cairo_move_to(cr, offset, offset);
+        clutter_cairo_set_source_color(cr, &entry->shadow_color);
+        pango_cairo_show_layout(cr, cache->layout);
+    }
+    cairo_move_to(cr, 0, 0);
+    clutter_cairo_set_source_color(cr, &entry->color);
+    pango_cairo_show_layout(cr, cache->layout);
+    cairo_destroy(cr);
+
+    /* the texture itself is never shown */
+    clutter_actor_hide(entry->texture);
+    clutter_container_add_actor(cache->container, entry->texture);
+    cache->bytes += width * height * 4;
+}
+
+static LabelCacheEntry *label_cache_entry_ref(LabelCache *cache, const char *text, const char *font, const ClutterColor *color, const ClutterColor *shadow_color)
+{
+    char *key = label_cache_key(text, font, color, shadow_color);
+    LabelCacheEntry *entry = g_hash_table_lookup(cache->entries, key);
+
+    cache->labels++;
+    if (entry) {
+        g_free(key);
+        entry->ref_count++;
+        cache->hits++;
+        return entry;
+    }
+
+    entry = g_new0(LabelCacheEntry, 1);
+    entry->key = key;
+    entry->text = g_strdup(text);
+    entry->font = g_strdup(font);
+    entry->color = *color;
+    if (shadow_color) {
+        entry->shadow_color = *shadow_color;
+        entry->has_shadow = TRUE;
+    }
+    entry->ref_count = 1;
+    label_cache_render(cache, entry);
+    g_object_set_data(G_OBJECT(entry->texture), "label-cache-entry", entry);
+    g_hash_table_insert(cache->entries, entry->key, entry);
+    cache->misses++;
+
+    return entry;
+}
+
+static void label_cache_entry_free(LabelCacheEntry *entry)
+{
+    g_free(entry->key);
+    g_free(entry->text);
+    g_free(entry->font);
+    g_free(entry);
+}
+
+static void label_cache_entry_unref(LabelCache *cache, LabelCacheEntry *entry)
+{
+    cache->labels--;
+    if (--entry->ref_count > 0) {
+        return;
+    }
+    cache->bytes -= clutter_actor_get_width(entry->texture) * clutter_actor_get_height(entry->texture) * 4;
+    g_object_set_data(G_OBJECT(entry->texture), "label-cache-entry", NULL);
+    clutter_actor_destroy(entry->texture);
+    g_hash_table_remove(cache->entries, entry->key);
+    label_cache_entry_free(entry);
+}
+
+/**
+ * Creates a label cache, the rendered textures are kept hidden in container.
+ */
+LabelCache *label_cache_new(ClutterContainer *container)
+{
+    LabelCache *cache = g_new0(LabelCache, 1);
+
+    cache->container = container;
+    cache->entries = g_hash_table_new(g_str_hash, g_str_equal);
+    cache->context = pango_cairo_font_map_create_context(PANGO_CAIRO_FONT_MAP(pango_cairo_font_map_get_default()));
+    cache->layout = pango_layout_new(cache->context);
+
+    return cache;
+}
+
+/* all labels have to be destroyed before */
+void label_cache_free(LabelCache *cache)
+{
+    if (!cache) {
+        return;
+    }
+    g_hash_table_destroy(cache->entries);
+    g_object_unref(cache->layout);
+    g_object_unref(cache->context);
+    g_free(cache);
+}
+
+/**
+ * Returns the texture of text in the given font and color, with a shadow
+ * if shadow_color is not NULL. Labels with the same text and style share
+ * one texture, its size is known right away. The texture is never shown
+ * itself, it is meant to be painted by the icons using it.
+ */
+ClutterActor *label_cache_ref(LabelCache *cache, const char *text, const char *font, const ClutterColor *color, const ClutterColor *shadow_color)
+{
+    return label_cache_entry_ref(cache, text, font, color, shadow_color)->texture;
+}
+
+void label_cache_unref(LabelCache *cache, ClutterActor *label)
+{
+    LabelCacheEntry *entry;
+
+    if (!label) {
+        return;
+    }
+    entry = g_object_get_data(G_OBJECT(label), "label-cache-entry");
+    if (entry) {
+        label_cache_entry_unref(cache, entry);
+    }
+}
+
+/* replaces the reference to label by one to the same label with text */
+ClutterActor *label_cache_set_text(LabelCache *cache, ClutterActor *label, const char *text)
+{
+    LabelCacheEntry *entry = label ? g_object_get_data(G_OBJECT(label), "label-cache-entry") : NULL;
+    LabelCacheEntry *result;
+
+    if (!entry || !strcmp(entry->text, text)) {
+        return label;
+    }
+    result = label_cache_entry_ref(cache, text, entry->font, &entry->color, entry->has_shadow ? &entry->shadow_color : NULL);
+    label_cache_entry_unref(cache, entry);
+    return result->texture;
+}
+
+/* replaces the reference to label by one to the same label in color */
+ClutterActor *label_cache_set_color(LabelCache *cache, ClutterActor *label, const ClutterColor *color)
+{
+    LabelCacheEntry *entry = label ? g_object_get_data(G_OBJECT(label), "label-cache-entry") : NULL;
+    LabelCacheEntry *result;
+
+    if (!entry || clutter_color_equal(&entry->color, color)) {
+        return label;
+    }
+    result = label_cache_entry_ref(cache, entry->text, entry->font, color, entry->has_shadow ? &entry->shadow_color : NULL);
+    label_cache_entry_unref(cache, entry);
+    return result->texture;
+}
+
+void label_cache_get_stats(LabelCache *cache, LabelCacheStats *stats)
+{
+    stats->labels = cache->labels;
+    stats->textures = g_hash_table_size(cache->entries);
+    stats->bytes = cache->bytes;
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+}
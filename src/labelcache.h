@@ -0,0 +1,52 @@
+/**
+ * labelcache.h
+ * Pre-rendered icon labels
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifndef LABELCACHE_H
+#define LABELCACHE_H
+
+#include <glib.h>
+#include <clutter/clutter.h>
+
+typedef struct _LabelCache LabelCache;
+
+typedef struct {
+    guint labels;
+    guint textures;
+    guint64 bytes;
+    guint hits;
+    guint misses;
+} LabelCacheStats;
+
+LabelCache *label_cache_new(ClutterContainer *container);
+void label_cache_free(LabelCache *cache);
+
+ClutterActor *label_cache_ref(LabelCache *cache, const char *text, const char *font, const ClutterColor *color, const ClutterColor *shadow_color);
+void label_cache_unref(LabelCache *cache, ClutterActor *label);
+ClutterActor *label_cache_set_text(LabelCache *cache, ClutterActor *label, const char *text);
+ClutterActor *label_cache_set_color(LabelCache *cache, ClutterActor *label, const ClutterColor *color);
+
+void label_cache_get_stats(LabelCache *cache, LabelCacheStats *stats);
+
+#endif
@@ -50,6 +50,7 @@ GtkWidget *btn_apply;
 
 char *match_uuid = NULL;
 char *current_uuid = NULL;
+gboolean agent_mode = FALSE;
 
 static gboolean win_map_cb(GtkWidget *widget, GdkEvent *event, gpointer *data)
 {
@@ -168,6 +169,9 @@ static void device_event_cb(const idevice_event_t *event, void *user_data)
             debug_printf("Device add event: adding device %s\n", event->uuid);
             current_uuid = g_strdup(event->uuid);
             g_thread_create(device_add_cb, current_uuid, FALSE, NULL);
+        } else if (agent_mode) {
+            debug_printf("Device add event: prefetching device %s\n", event->uuid);
+            sbmgr_prefetch(event->uuid);
         } else {
             debug_printf("Device add event: ignoring device %s\n", event->uuid);
         }
@@ -271,6 +275,7 @@ static void print_usage(int argc, char **argv)
     printf("  -d, --debug\t\tenable communication debugging\n");
     printf("  -D, --debug-app\tenable application debug messages\n");
     printf("  -u, --uuid UUID\ttarget specific device by its 40-digit device UUID\n");
+    printf("  -a, --agent\t\tprefetch icons of all attached devices in the background\n");
     printf("  -h, --help\t\tprints usage information\n");
     printf("\n");
 }
@@ -295,6 +300,9 @@ int main(int argc, char **argv)
             }
             match_uuid = g_strndup(argv[i], 40);
             continue;
+        } else if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "--agent")) {
+            agent_mode = TRUE;
+            continue;
         } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
             print_usage(argc, argv);
             return 0;
@@ -0,0 +1,458 @@
+/**
+ * plistwriter.c
+ * Streaming binary plist writer
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+ #include <config.h>
+#endif
+
+#include <string.h>
+
+#include "plistwriter.h"
+
+/* object references are always written with 4 bytes */
+#define REF_SIZE 4
+#define MAX_DEPTH 32
+
+/* a binary plist being read, e.g. an SBItem's blob of extra keys */
+typedef struct {
+    const guint8 *data;
+    guint32 length;
+    guint offset_size;
+    guint ref_size;
+    guint64 num_objects;
+    guint64 top_object;
+    guint64 offset_table;
+} PlistSource;
+
+static guint64 read_be(const guint8 *p, guint size)
+{
+    guint64 value = 0;
+    guint i;
+
+    for (i = 0; i < size; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+PlistWriter *plistwriter_new()
+{
+    PlistWriter *writer = g_new0(PlistWriter, 1);
+
+    writer->data = g_byte_array_new();
+    writer->offsets = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+    return writer;
+}
+
+void plistwriter_free(PlistWriter *writer)
+{
+    if (writer) {
+        g_byte_array_free(writer->data, TRUE);
+        g_array_free(writer->offsets, TRUE);
+        g_free(writer);
+    }
+}
+
+static void plistwriter_append_be(PlistWriter *writer, guint64 value, guint size)
+{
+    guint8 buf[8];
+    guint i;
+
+    for (i = 0; i < size; i++) {
+        buf[size - 1 - i] = (value >> (8 * i)) & 0xff;
+    }
+    g_byte_array_append(writer->data, buf, size);
+}
+
+static void plistwriter_append_byte(PlistWriter *writer, guint8 value)
+{
+    g_byte_array_append(writer->data, &value, 1);
+}
+
+static guint plistwriter_new_object(PlistWriter *writer)
+{
+    guint64 offset = writer->data->len;
+
+    g_array_append_val(writer->offsets, offset);
+    return writer->offsets->len - 1;
+}
+
+static void plistwriter_append_marker(PlistWriter *writer, guint8 type, guint64 length)
+{
+    if (length < 15) {
+        plistwriter_append_byte(writer, type | length);
+        return;
+    }
+    /* larger lengths follow as an integer object */
+    plistwriter_append_byte(writer, type | 0x0f);
+    if (length <= G_MAXUINT8) {
+        plistwriter_append_byte(writer, 0x10);
+        plistwriter_append_be(writer, length, 1);
+    } else if (length <= G_MAXUINT16) {
+        plistwriter_append_byte(writer, 0x11);
+        plistwriter_append_be(writer, length, 2);
+    } else if (length <= G_MAXUINT32) {
+        plistwriter_append_byte(writer, 0x12);
+        plistwriter_append_be(writer, length, 4);
+    } else {
+        plistwriter_append_byte(writer, 0x13);
+        plistwriter_append_be(writer, length, 8);
+    }
+}
+
+static guint plistwriter_reserve_refs(PlistWriter *writer, guint count)
+{
+    guint refs = writer->data->len;
+
+    g_byte_array_set_size(writer->data, refs + count * REF_SIZE);
+    memset(writer->data->data + refs, '\0', count * REF_SIZE);
+
+    return refs;
+}
+
+/**
+ * Empties the buffer and starts a new plist. The first object added
+ * afterwards is the root object.
+ */
+void plistwriter_begin(PlistWriter *writer)
+{
+    g_byte_array_set_size(writer->data, 0);
+    g_array_set_size(writer->offsets, 0);
+    g_byte_array_append(writer->data, (const guint8*)"bplist00", 8);
+}
+
+/* appends offset table and trailer */
+void plistwriter_end(PlistWriter *writer)
+{
+    guint64 offset_table = writer->data->len;
+    guint offset_size = 8;
+    guint i;
+
+    if (offset_table <= G_MAXUINT8) {
+        offset_size = 1;
+    } else if (offset_table <= G_MAXUINT16) {
+        offset_size = 2;
+    } else if (offset_table <= G_MAXUINT32) {
+        offset_size = 4;
+    }
+
+    for (i = 0; i < writer->offsets->len; i++) {
+        plistwriter_append_be(writer, g_array_index(writer->offsets, guint64, i), offset_size);
+    }
+
+    plistwriter_append_be(writer, 0, 6);
+    plistwriter_append_byte(writer, offset_size);
+    plistwriter_append_byte(writer, REF_SIZE);
+    plistwriter_append_be(writer, writer->offsets->len, 8);
+    plistwriter_append_be(writer, 0, 8);
+    plistwriter_append_be(writer, offset_table, 8);
+}
+
+guint plistwriter_add_bool(PlistWriter *writer, gboolean value)
+{
+    guint index = plistwriter_new_object(writer);
+
+    plistwriter_append_byte(writer, value ? 0x09 : 0x08);
+    return index;
+}
+
+guint plistwriter_add_string(PlistWriter *writer, const char *value)
+{
+    guint index = plistwriter_new_object(writer);
+    const char *p;
+    guint64 units = 0;
+
+    for (p = value; *p; p++) {
+        if (*p & 0x80) {
+            break;
+        }
+    }
+    if (!*p) {
+        plistwriter_append_marker(writer, 0x50, p - value);
+        g_byte_array_append(writer->data, (const guint8*)value, p - value);
+        return index;
+    }
+
+    /* anything that is not plain ASCII is stored as UTF-16BE */
+    for (p = value; *p; p = g_utf8_next_char(p)) {
+        units += (g_utf8_get_char(p) > 0xffff) ? 2 : 1;
+    }
+    plistwriter_append_marker(writer, 0x60, units);
+    for (p = value; *p; p = g_utf8_next_char(p)) {
+        gunichar c = g_utf8_get_char(p);
+        if (c > 0xffff) {
+            c -= 0x10000;
+            plistwriter_append_be(writer, 0xd800 + (c >> 10), 2);
+            plistwriter_append_be(writer, 0xdc00 + (c & 0x3ff), 2);
+        } else {
+            plistwriter_append_be(writer, c, 2);
+        }
+    }
+    return index;
+}
+
+guint plistwriter_add_date(PlistWriter *writer, glong sec, glong usec)
+{
+    guint index = plistwriter_new_object(writer);
+    gdouble value = (gdouble)sec + (gdouble)usec / 1000000;
+    guint64 bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    plistwriter_append_byte(writer, 0x33);
+    plistwriter_append_be(writer, bits, 8);
+    return index;
+}
+
+/**
+ * Starts an array of count elements. The references to the elements
+ * are filled in with plistwriter_set_ref() once they are written.
+ */
+guint plistwriter_begin_array(PlistWriter *writer, guint count, guint *refs)
+{
+    guint index = plistwriter_new_object(writer);
+
+    plistwriter_append_marker(writer, 0xa0, count);
+    *refs = plistwriter_reserve_refs(writer, count);
+    return index;
+}
+
+guint plistwriter_begin_dict(PlistWriter *writer, guint count, guint *refs)
+{
+    guint index = plistwriter_new_object(writer);
+
+    plistwriter_append_marker(writer, 0xd0, count);
+    *refs = plistwriter_reserve_refs(writer, 2 * count);
+    return index;
+}
+
+void plistwriter_set_ref(PlistWriter *writer, guint refs, guint slot, guint object)
+{
+    guint8 *p = writer->data->data + refs + slot * REF_SIZE;
+
+    p[0] = (object >> 24) & 0xff;
+    p[1] = (object >> 16) & 0xff;
+    p[2] = (object >> 8) & 0xff;
+    p[3] = object & 0xff;
+}
+
+void plistwriter_set_dict_entry(PlistWriter *writer, guint refs, guint count, guint slot, guint key, guint value)
+{
+    plistwriter_set_ref(writer, refs, slot, key);
+    plistwriter_set_ref(writer, refs, count + slot, value);
+}
+
+static gboolean plist_source_init(PlistSource *src, const char *bin, guint32 length)
+{
+    const guint8 *trailer;
+
+    if (!bin || (length < 8 + 32) || memcmp(bin, "bplist00", 8)) {
+        return FALSE;
+    }
+    src->data = (const guint8*)bin;
+    src->length = length;
+
+    trailer = src->data + length - 32;
+    src->offset_size = trailer[6];
+    src->ref_size = trailer[7];
+    src->num_objects = read_be(trailer + 8, 8);
+    src->top_object = read_be(trailer + 16, 8);
+    src->offset_table = read_be(trailer + 24, 8);
+
+    if ((src->offset_size < 1) || (src->offset_size > 8) || (src->ref_size < 1) || (src->ref_size > 8)) {
+        return FALSE;
+    }
+    if ((src->offset_table > length - 32) || (src->num_objects > (length - 32 - src->offset_table) / src->offset_size)) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static const guint8 *plist_source_object(PlistSource *src, guint64 index)
+{
+    guint64 offset;
+
+    if (index >= src->num_objects) {
+        return NULL;
+    }
+    offset = read_be(src->data + src->offset_table + index * src->offset_size, src->offset_size);
+    if ((offset < 8) || (offset >= src->offset_table)) {
+        return NULL;
+    }
+    return src->data + offset;
+}
+
+/* gets the length of a string, data or container object and where its contents start */
+static gboolean plist_source_length(PlistSource *src, const guint8 *object, guint64 *length, const guint8 **payload)
+{
+    const guint8 *end = src->data + src->offset_table;
+    guint size;
+
+    if ((object[0] & 0x0f) != 0x0f) {
+        *length = object[0] & 0x0f;
+        *payload = object + 1;
+        return TRUE;
+    }
+    if ((object + 2 > end) || ((object[1] & 0xf0) != 0x10)) {
+        return FALSE;
+    }
+    size = 1 << (object[1] & 0x0f);
+    if ((size > 8) || (object + 2 + size > end)) {
+        return FALSE;
+    }
+    *length = read_be(object + 2, size);
+    *payload = object + 2 + size;
+    return TRUE;
+}
+
+static gboolean plistwriter_copy_object(PlistWriter *writer, PlistSource *src, guint64 index, guint depth, guint *result)
+{
+    const guint8 *end = src->data + src->offset_table;
+    const guint8 *object = plist_source_object(src, index);
+    const guint8 *payload = NULL;
+    guint64 length = 0;
+    guint64 size;
+    guint64 i;
+    guint refs;
+    guint child;
+
+    if (!object || (depth > MAX_DEPTH)) {
+        return FALSE;
+    }
+
+    switch (object[0] >> 4) {
+        case 0x0:
+        size = 1;
+        break;
+        case 0x1:
+        case 0x2:
+        size = 1 + (1 << (object[0] & 0x0f));
+        break;
+        case 0x3:
+        size = 9;
+        break;
+        case 0x4:
+        case 0x5:
+        case 0x6:
+        if (!plist_source_length(src, object, &length, &payload)) {
+            return FALSE;
+        }
+        size = (payload - object) + length * (((object[0] >> 4) == 0x6) ? 2 : 1);
+        break;
+        case 0x8:
+        size = 1 + (object[0] & 0x0f) + 1;
+        break;
+        case 0xa:
+        case 0xd:
+        if (!plist_source_length(src, object, &length, &payload)) {
+            return FALSE;
+        }
+        if ((object[0] >> 4) == 0xa) {
+            if (payload + length * src->ref_size > end) {
+                return FALSE;
+            }
+            *result = plistwriter_begin_array(writer, length, &refs);
+            for (i = 0; i < length; i++) {
+                if (!plistwriter_copy_object(writer, src, read_be(payload + i * src->ref_size, src->ref_size), depth + 1, &child)) {
+                    return FALSE;
+                }
+                plistwriter_set_ref(writer, refs, i, child);
+            }
+        } else {
+            if (payload + 2 * length * src->ref_size > end) {
+                return FALSE;
+            }
+            *result = plistwriter_begin_dict(writer, length, &refs);
+            for (i = 0; i < 2 * length; i++) {
+                if (!plistwriter_copy_object(writer, src, read_be(payload + i * src->ref_size, src->ref_size), depth + 1, &child)) {
+                    return FALSE;
+                }
+                plistwriter_set_ref(writer, refs, i, child);
+            }
+        }
+        return TRUE;
+        default:
+        return FALSE;
+    }
+
+    /* scalars are self contained and can be copied as they are */
+    if (object + size > end) {
+        return FALSE;
+    }
+    *result = plistwriter_new_object(writer);
+    g_byte_array_append(writer->data, object, size);
+    return TRUE;
+}
+
+/* number of entries of the root dict in bin, 0 if it is not a dict */
+guint plistwriter_get_dict_size(const char *bin, guint32 length)
+{
+    PlistSource src;
+    const guint8 *root;
+    const guint8 *payload;
+    guint64 count;
+
+    if (!plist_source_init(&src, bin, length)) {
+        return 0;
+    }
+    root = plist_source_object(&src, src.top_object);
+    if (!root || ((root[0] >> 4) != 0xd) || !plist_source_length(&src, root, &count, &payload)) {
+        return 0;
+    }
+    return count;
+}
+
+/**
+ * Copies the entries of the root dict in bin into the dict opened with
+ * plistwriter_begin_dict(), starting at first_slot.
+ */
+gboolean plistwriter_copy_dict_entries(PlistWriter *writer, const char *bin, guint32 length, guint refs, guint count, guint first_slot)
+{
+    PlistSource src;
+    const guint8 *root;
+    const guint8 *payload;
+    guint64 entries;
+    guint64 i;
+    guint key, value;
+
+    if (!plist_source_init(&src, bin, length)) {
+        return FALSE;
+    }
+    root = plist_source_object(&src, src.top_object);
+    if (!root || ((root[0] >> 4) != 0xd) || !plist_source_length(&src, root, &entries, &payload)) {
+        return FALSE;
+    }
+    if (payload + 2 * entries * src.ref_size > src.data + src.offset_table) {
+        return FALSE;
+    }
+    for (i = 0; i < entries; i++) {
+        if (!plistwriter_copy_object(writer, &src, read_be(payload + i * src.ref_size, src.ref_size), 0, &key)
+            || !plistwriter_copy_object(writer, &src, read_be(payload + (entries + i) * src.ref_size, src.ref_size), 0, &value)) {
+            return FALSE;
+        }
+        plistwriter_set_dict_entry(writer, refs, count, first_slot + i, key, value);
+    }
+    return TRUE;
+}
@@ -0,0 +1,55 @@
+/**
+ * plistwriter.h
+ * Streaming binary plist writer (header file)
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifndef PLISTWRITER_H
+#define PLISTWRITER_H
+
+#include <glib.h>
+
+/* writes a binary plist front to back into a buffer that is kept around */
+typedef struct {
+    GByteArray *data;
+    GArray *offsets;
+} PlistWriter;
+
+PlistWriter *plistwriter_new();
+void plistwriter_free(PlistWriter *writer);
+
+void plistwriter_begin(PlistWriter *writer);
+void plistwriter_end(PlistWriter *writer);
+
+guint plistwriter_add_bool(PlistWriter *writer, gboolean value);
+guint plistwriter_add_string(PlistWriter *writer, const char *value);
+guint plistwriter_add_date(PlistWriter *writer, glong sec, glong usec);
+
+guint plistwriter_begin_array(PlistWriter *writer, guint count, guint *refs);
+guint plistwriter_begin_dict(PlistWriter *writer, guint count, guint *refs);
+void plistwriter_set_ref(PlistWriter *writer, guint refs, guint slot, guint object);
+void plistwriter_set_dict_entry(PlistWriter *writer, guint refs, guint count, guint slot, guint key, guint value);
+
+guint plistwriter_get_dict_size(const char *bin, guint32 length);
+gboolean plistwriter_copy_dict_entries(PlistWriter *writer, const char *bin, guint32 length, guint refs, guint count, guint first_slot);
+
+#endif
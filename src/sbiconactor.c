@@ -0,0 +1,228 @@
+/**
+ * sbiconactor.c
+ * Actor drawing a complete SpringBoard icon
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+ #include <config.h>
+#endif
+
+#include "sbiconactor.h"
+
+typedef struct {
+    ClutterActor *texture;
+    gfloat x;
+    gfloat y;
+    gfloat width;
+    gfloat height;
+} SBIconMini;
+
+struct _SBIconActorPrivate {
+    CoglHandle material;
+    ClutterActor *shadow;
+    gfloat shadow_margin;
+    gboolean shadow_visible;
+    ClutterActor *label;
+    gboolean label_visible;
+    GArray *minis;
+};
+
+G_DEFINE_TYPE(SBIconActor, sb_icon_actor, CLUTTER_TYPE_TEXTURE)
+
+#define SB_ICON_ACTOR_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), SB_TYPE_ICON_ACTOR, SBIconActorPrivate))
+
+/* the referenced textures are shared, they are never shown themselves */
+static void sb_icon_actor_paint_texture(SBIconActor *icon, ClutterActor *source, gfloat x, gfloat y, gfloat width, gfloat height, guint8 opacity)
+{
+    SBIconActorPrivate *priv = icon->priv;
+    CoglHandle texture = clutter_texture_get_cogl_texture(CLUTTER_TEXTURE(source));
+
+    if (texture == COGL_INVALID_HANDLE) {
+        return;
+    }
+    cogl_material_set_layer(priv->material, 0, texture);
+    cogl_material_set_color4ub(priv->material, opacity, opacity, opacity, opacity);
+    cogl_set_source(priv->material);
+    cogl_rectangle(x, y, x + width, y + height);
+}
+
+static void sb_icon_actor_paint(ClutterActor *actor)
+{
+    SBIconActor *icon = SB_ICON_ACTOR(actor);
+    SBIconActorPrivate *priv = icon->priv;
+    guint8 opacity = clutter_actor_get_paint_opacity(actor);
+    gfloat width, height;
+    guint i;
+
+    clutter_actor_get_size(actor, &width, &height);
+
+    if (priv->shadow && priv->shadow_visible) {
+        sb_icon_actor_paint_texture(icon, priv->shadow, -priv->shadow_margin, -priv->shadow_margin,
+                                    width + priv->shadow_margin * 2, height + priv->shadow_margin * 2, opacity);
+    }
+
+    CLUTTER_ACTOR_CLASS(sb_icon_actor_parent_class)->paint(actor);
+
+    for (i = 0; i < priv->minis->len; i++) {
+        SBIconMini *mini = &g_array_index(priv->minis, SBIconMini, i);
+        sb_icon_actor_paint_texture(icon, mini->texture, mini->x, mini->y, mini->width, mini->height, opacity);
+    }
+
+    /* centered below the icon */
+    if (priv->label && priv->label_visible) {
+        gfloat label_width, label_height;
+        clutter_actor_get_size(priv->label, &label_width, &label_height);
+        sb_icon_actor_paint_texture(icon, priv->label, (gint)((width - label_width) / 2), height,
+                                    label_width, label_height, opacity);
+    }
+}
+
+static void sb_icon_actor_dispose(GObject *object)
+{
+    SBIconActor *icon = SB_ICON_ACTOR(object);
+    SBIconActorPrivate *priv = icon->priv;
+
+    sb_icon_actor_set_shadow(icon, NULL, 0);
+    sb_icon_actor_set_label(icon, NULL);
+    sb_icon_actor_clear_minis(icon);
+    if (priv->material != COGL_INVALID_HANDLE) {
+        cogl_handle_unref(priv->material);
+        priv->material = COGL_INVALID_HANDLE;
+    }
+
+    G_OBJECT_CLASS(sb_icon_actor_parent_class)->dispose(object);
+}
+
+static void sb_icon_actor_finalize(GObject *object)
+{
+    SBIconActor *icon = SB_ICON_ACTOR(object);
+
+    g_array_free(icon->priv->minis, TRUE);
+
+    G_OBJECT_CLASS(sb_icon_actor_parent_class)->finalize(object);
+}
+
+static void sb_icon_actor_class_init(SBIconActorClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS(klass);
+
+    object_class->dispose = sb_icon_actor_dispose;
+    object_class->finalize = sb_icon_actor_finalize;
+    actor_class->paint = sb_icon_actor_paint;
+
+    g_type_class_add_private(klass, sizeof(SBIconActorPrivate));
+}
+
+static void sb_icon_actor_init(SBIconActor *icon)
+{
+    SBIconActorPrivate *priv = SB_ICON_ACTOR_GET_PRIVATE(icon);
+
+    icon->priv = priv;
+    priv->material = cogl_material_new();
+    priv->minis = g_array_new(FALSE, FALSE, sizeof(SBIconMini));
+}
+
+ClutterActor *sb_icon_actor_new(void)
+{
+    return CLUTTER_ACTOR(g_object_new(SB_TYPE_ICON_ACTOR, NULL));
+}
+
+/**
+ * Sets the texture painted behind the icon, extending margin pixels
+ * beyond each of its edges. The shadow starts out hidden.
+ */
+void sb_icon_actor_set_shadow(SBIconActor *icon, ClutterActor *shadow, gfloat margin)
+{
+    SBIconActorPrivate *priv = icon->priv;
+
+    if (shadow) {
+        g_object_ref(shadow);
+    }
+    if (priv->shadow) {
+        g_object_unref(priv->shadow);
+    }
+    priv->shadow = shadow;
+    priv->shadow_margin = margin;
+    clutter_actor_queue_redraw(CLUTTER_ACTOR(icon));
+}
+
+void sb_icon_actor_set_shadow_visible(SBIconActor *icon, gboolean visible)
+{
+    if (icon->priv->shadow_visible != visible) {
+        icon->priv->shadow_visible = visible;
+        clutter_actor_queue_redraw(CLUTTER_ACTOR(icon));
+    }
+}
+
+/* sets the texture painted centered below the icon, it starts out hidden */
+void sb_icon_actor_set_label(SBIconActor *icon, ClutterActor *label)
+{
+    SBIconActorPrivate *priv = icon->priv;
+
+    if (label == priv->label) {
+        return;
+    }
+    if (label) {
+        g_object_ref(label);
+    }
+    if (priv->label) {
+        g_object_unref(priv->label);
+    }
+    priv->label = label;
+    clutter_actor_queue_redraw(CLUTTER_ACTOR(icon));
+}
+
+void sb_icon_actor_set_label_visible(SBIconActor *icon, gboolean visible)
+{
+    if (icon->priv->label_visible != visible) {
+        icon->priv->label_visible = visible;
+        clutter_actor_queue_redraw(CLUTTER_ACTOR(icon));
+    }
+}
+
+void sb_icon_actor_clear_minis(SBIconActor *icon)
+{
+    SBIconActorPrivate *priv = icon->priv;
+    guint i;
+
+    for (i = 0; i < priv->minis->len; i++) {
+        g_object_unref(g_array_index(priv->minis, SBIconMini, i).texture);
+    }
+    g_array_set_size(priv->minis, 0);
+    clutter_actor_queue_redraw(CLUTTER_ACTOR(icon));
+}
+
+/* adds a scaled down texture painted on top of the icon at x, y */
+void sb_icon_actor_add_mini(SBIconActor *icon, ClutterActor *texture, gfloat x, gfloat y, gfloat width, gfloat height)
+{
+    SBIconMini mini;
+
+    mini.texture = g_object_ref(texture);
+    mini.x = x;
+    mini.y = y;
+    mini.width = width;
+    mini.height = height;
+    g_array_append_val(icon->priv->minis, mini);
+    clutter_actor_queue_redraw(CLUTTER_ACTOR(icon));
+}
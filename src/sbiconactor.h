@@ -0,0 +1,62 @@
+/**
+ * sbiconactor.h
+ * Actor drawing a complete SpringBoard icon
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifndef SBICONACTOR_H
+#define SBICONACTOR_H
+
+#include <glib-object.h>
+#include <clutter/clutter.h>
+
+#define SB_TYPE_ICON_ACTOR (sb_icon_actor_get_type())
+#define SB_ICON_ACTOR(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), SB_TYPE_ICON_ACTOR, SBIconActor))
+#define SB_IS_ICON_ACTOR(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), SB_TYPE_ICON_ACTOR))
+
+typedef struct _SBIconActor SBIconActor;
+typedef struct _SBIconActorClass SBIconActorClass;
+typedef struct _SBIconActorPrivate SBIconActorPrivate;
+
+/* a texture that also paints its shadow, its label and, for folders,
+ * the previews of the contained icons, so an icon is a single actor */
+struct _SBIconActor {
+    ClutterTexture parent;
+    SBIconActorPrivate *priv;
+};
+
+struct _SBIconActorClass {
+    ClutterTextureClass parent_class;
+};
+
+GType sb_icon_actor_get_type(void);
+
+ClutterActor *sb_icon_actor_new(void);
+
+void sb_icon_actor_set_shadow(SBIconActor *icon, ClutterActor *shadow, gfloat margin);
+void sb_icon_actor_set_shadow_visible(SBIconActor *icon, gboolean visible);
+void sb_icon_actor_set_label(SBIconActor *icon, ClutterActor *label);
+void sb_icon_actor_set_label_visible(SBIconActor *icon, gboolean visible);
+void sb_icon_actor_clear_minis(SBIconActor *icon);
+void sb_icon_actor_add_mini(SBIconActor *icon, ClutterActor *texture, gfloat x, gfloat y, gfloat width, gfloat height);
+
+#endif
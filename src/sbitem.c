@@ -28,28 +28,170 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "sbitem.h"
+#include "sbpage.h"
 
-char *sbitem_get_display_name(SBItem *item)
+const char *sbitem_get_display_name(SBItem *item)
 {
+    return item->display_name;
+}
+
+const char *sbitem_get_display_identifier(SBItem *item)
+{
+    return item->display_identifier;
+}
+
+void sbitem_set_display_name(SBItem *item, const char *display_name)
+{
+    item->display_name = g_intern_string(display_name);
+}
+
+/**
+ * Returns the string value for key as a process wide interned string.
+ * The same identifier always maps to the same pointer, so interned
+ * strings can be compared and hashed directly. They must not be freed.
+ */
+const char *sbitem_intern_string_val(plist_t icon_info, const char *key)
+{
+    const char *result = NULL;
     char *strval = NULL;
-    plist_t node = plist_dict_get_item(item->node, "displayName");
+    plist_t node = plist_dict_get_item(icon_info, key);
     if (node && plist_get_node_type(node) == PLIST_STRING) {
         plist_get_string_val(node, &strval);
     }
-    return strval;
+    if (strval) {
+        result = g_intern_string(strval);
+        free(strval);
+    }
+    return result;
 }
 
+static gboolean sbitem_parse_mod_date(plist_t icon_info, GTimeVal *mod_date)
+{
+    int32_t sec = 0;
+    int32_t usec = 0;
+    plist_t node = plist_dict_get_item(icon_info, "iconModDate");
+
+    mod_date->tv_sec = 0;
+    mod_date->tv_usec = 0;
+    if (!node || (plist_get_node_type(node) != PLIST_DATE)) {
+        return FALSE;
+    }
+    plist_get_date_val(node, &sec, &usec);
+    mod_date->tv_sec = sec;
+    mod_date->tv_usec = usec;
+    return TRUE;
+}
 
-char *sbitem_get_display_identifier(SBItem *item)
+gboolean sbitem_update_icon_mod_date(SBItem *item, const GTimeVal *mod_date)
 {
-    char *strval = NULL;
-    plist_t node = plist_dict_get_item(item->node, "displayIdentifier");
-    if (node && plist_get_node_type(node) == PLIST_STRING) {
-        plist_get_string_val(node, &strval);
+    gboolean changed = TRUE;
+
+    if ((mod_date->tv_sec != 0) && (item->icon_mod_date.tv_sec != 0)) {
+        changed = ((mod_date->tv_sec != item->icon_mod_date.tv_sec) || (mod_date->tv_usec != item->icon_mod_date.tv_usec));
     }
-    return strval;
+    /* without a date there is no way to tell, so assume it has changed */
+    item->icon_mod_date = *mod_date;
+
+    return changed;
+}
+
+static gboolean sbitem_is_parsed_key(const char *key)
+{
+    return (!strcmp(key, "displayIdentifier") || !strcmp(key, "displayName")
+            || !strcmp(key, "iconModDate") || !strcmp(key, "iconLists"));
+}
+
+static void sbitem_store_extra(SBItem *item, plist_t icon_info)
+{
+    plist_dict_iter iter = NULL;
+    plist_t extra = NULL;
+    plist_t node = NULL;
+    char *key = NULL;
+
+    /* keys we do not know about are copied, they are serialized when
+     * the item is written for the first time */
+    plist_dict_new_iter(icon_info, &iter);
+    if (!iter) {
+        return;
+    }
+    do {
+        key = NULL;
+        node = NULL;
+        plist_dict_next_item(icon_info, iter, &key, &node);
+        if (key && node && !sbitem_is_parsed_key(key)) {
+            if (!extra) {
+                extra = plist_new_dict();
+            }
+            plist_dict_insert_item(extra, key, plist_copy(node));
+        }
+        free(key);
+    } while (node);
+    free(iter);
+
+    item->extra_node = extra;
+}
+
+/**
+ * Returns the unknown keys of item as a binary plist dict, or NULL if
+ * there are none. They are serialized on the first call.
+ */
+const char *sbitem_get_extra(SBItem *item, guint32 *length)
+{
+    if (item->extra_node) {
+        plist_to_bin(item->extra_node, &item->extra, &item->extra_length);
+        plist_free(item->extra_node);
+        item->extra_node = NULL;
+    }
+    *length = item->extra_length;
+    return item->extra;
+}
+
+plist_t sbitem_get_node(SBItem *item)
+{
+    plist_t dict = NULL;
+    guint32 length = 0;
+    const char *extra = sbitem_get_extra(item, &length);
+
+    if (extra) {
+        plist_from_bin(extra, length, &dict);
+    }
+    if (!dict) {
+        dict = plist_new_dict();
+    }
+    if (item->display_identifier) {
+        plist_dict_insert_item(dict, "displayIdentifier", plist_new_string(item->display_identifier));
+    }
+    if (item->display_name) {
+        plist_dict_insert_item(dict, "displayName", plist_new_string(item->display_name));
+    }
+    if (item->icon_mod_date.tv_sec != 0) {
+        plist_dict_insert_item(dict, "iconModDate", plist_new_date(item->icon_mod_date.tv_sec, item->icon_mod_date.tv_usec));
+    }
+    return dict;
+}
+
+static SBPool *item_pool = NULL;
+static GDestroyNotify destroy_notify = NULL;
+
+/**
+ * Sets the function that releases whatever a view attached to an item,
+ * it is called by sbitem_free() before the item itself goes away.
+ */
+void sbitem_set_destroy_notify(GDestroyNotify func)
+{
+    destroy_notify = func;
+}
+
+/**
+ * Makes sbitem_new() take its items from pool, or from the heap again
+ * if pool is NULL. Items remember where they came from.
+ */
+void sbitem_set_pool(SBPool *pool)
+{
+    item_pool = pool;
 }
 
 SBItem *sbitem_new(plist_t icon_info)
@@ -60,8 +202,21 @@ SBItem *sbitem_new(plist_t icon_info)
         return item;
     }
 
-    item = g_new0(SBItem, 1);
-    item->node = plist_copy(icon_info);
+    if (item_pool) {
+        item = sbpool_alloc0(item_pool);
+        item->pool = item_pool;
+    } else {
+        item = g_new0(SBItem, 1);
+    }
+    item->display_identifier = sbitem_intern_string_val(icon_info, "displayIdentifier");
+    item->display_name = sbitem_intern_string_val(icon_info, "displayName");
+    if (item->display_identifier) {
+        char *path = sbitem_build_icon_filename(item->display_identifier);
+        item->icon_filename = g_intern_string(path);
+        g_free(path);
+    }
+    sbitem_parse_mod_date(icon_info, &item->icon_mod_date);
+    sbitem_store_extra(item, icon_info);
     item->texture = NULL;
     item->drawn = FALSE;
     item->is_dock_item = FALSE;
@@ -72,11 +227,12 @@ SBItem *sbitem_new(plist_t icon_info)
     return item;
 }
 
-SBItem *sbitem_new_with_subitems(plist_t icon_info, GList *subitems)
+SBItem *sbitem_new_with_subitems(plist_t icon_info, SBPage *subitems)
 {
     SBItem *item = sbitem_new(icon_info);
     if (item) {
         item->subitems = subitems;
+        subitems->folder = item;
 	item->is_folder = TRUE;
     }
     return item;
@@ -85,38 +241,47 @@ SBItem *sbitem_new_with_subitems(plist_t icon_info, GList *subitems)
 void sbitem_free(SBItem *item)
 {
     if (item) {
-        if (item->node) {
-            plist_free(item->node);
+        free(item->extra);
+        if (item->extra_node) {
+            plist_free(item->extra_node);
         }
-        if (item->texture && CLUTTER_IS_ACTOR(item->texture)) {
-            ClutterActor *parent = clutter_actor_get_parent(item->texture);
-            if (parent) {
-                clutter_actor_destroy(parent);
-                item->texture = NULL;
-                item->label = NULL;
-            } else {
-                clutter_actor_destroy(item->texture);
-                item->texture = NULL;
-            }
+        if (destroy_notify) {
+            destroy_notify(item);
         }
-        if (item->texture_shadow && CLUTTER_IS_ACTOR(item->texture_shadow)) {
-            clutter_actor_destroy(item->texture_shadow);
-            item->texture_shadow = NULL;
+        if (item->subitems) {
+            sbpage_free(item->subitems, TRUE);
         }
-        if (item->label_shadow && CLUTTER_IS_ACTOR(item->label_shadow)) {
-            clutter_actor_destroy(item->label_shadow);
-            item->label_shadow = NULL;
+        if (item->pool) {
+            sbpool_release(item->pool, item);
+        } else {
+            g_free(item);
         }
+    }
+}
 
+/**
+ * Frees what item owns besides its pool block, for pools that are reset
+ * as a whole. Items that do not come from a pool are freed entirely.
+ */
+void sbitem_release(SBItem *item)
+{
+    if (item) {
+        free(item->extra);
+        item->extra = NULL;
+        if (item->extra_node) {
+            plist_free(item->extra_node);
+            item->extra_node = NULL;
+        }
+        if (destroy_notify) {
+            destroy_notify(item);
+        }
         if (item->subitems) {
-            g_list_foreach(item->subitems, (GFunc)(g_func_sbitem_free), NULL);
-            g_list_free(item->subitems);
+            sbpage_release(item->subitems, TRUE);
+            item->subitems = NULL;
         }
-        if (item->label && CLUTTER_IS_ACTOR(item->label)) {
-            clutter_actor_destroy(item->label);
-            item->label = NULL;
+        if (!item->pool) {
+            g_free(item);
         }
-        free(item);
     }
 }
 
@@ -125,12 +290,14 @@ void g_func_sbitem_free(SBItem *item, gpointer data)
     sbitem_free(item);
 }
 
-char *sbitem_get_icon_filename(SBItem *item)
+char *sbitem_build_icon_filename(const char *display_identifier)
 {
     static gboolean create_dir = FALSE;
-    const char *value;
     char *filename, *path;
 
+    if (!display_identifier)
+        return NULL;
+
     if (create_dir == FALSE) {
       path = g_build_filename (g_get_user_cache_dir (),
 			       "libimobiledevice",
@@ -140,11 +307,7 @@ char *sbitem_get_icon_filename(SBItem *item)
       g_free (path);
     }
 
-    value = sbitem_get_display_identifier(item);
-    if (!value)
-        return NULL;
-
-    filename = g_strdup_printf ("%s.png", value);
+    filename = g_strdup_printf ("%s.png", display_identifier);
     path = g_build_filename (g_get_user_cache_dir (),
 			     "libimobiledevice",
 			     "icons",
@@ -152,3 +315,8 @@ char *sbitem_get_icon_filename(SBItem *item)
     g_free (filename);
     return path;
 }
+
+const char *sbitem_get_icon_filename(SBItem *item)
+{
+    return item->icon_filename;
+}
@@ -27,29 +27,60 @@
 #define SBITEM_H
 
 #include <glib.h>
-#include <clutter/clutter.h>
 #include <plist/plist.h>
 
+#include "sbpool.h"
+
+typedef struct _SBPage SBPage;
+
 typedef struct {
-    plist_t node;
-    ClutterActor *texture;
-    ClutterActor *texture_shadow;
-    ClutterActor *label;
-    ClutterActor *label_shadow;
+    const char *display_identifier;
+    const char *display_name;
+    const char *icon_filename;
+    GTimeVal icon_mod_date;
+    /* unknown keys, serialized from extra_node when first needed */
+    char *extra;
+    guint32 extra_length;
+    plist_t extra_node;
+    /* owned by the view, see sbitem_set_destroy_notify() */
+    struct _ClutterActor *texture;
+    struct _ClutterActor *label;
+    /* reduced copy of the icon for folder previews */
+    struct _ClutterActor *mini_texture;
     gboolean drawn;
+    /* loading of the icon has been started */
+    gboolean texture_requested;
+    /* the icon has to be fetched once the device is connected */
+    gboolean texture_deferred;
+    /* the icon texture was given back while the page is out of sight */
+    gboolean texture_evicted;
     gboolean is_dock_item;
     gboolean is_folder;
     gboolean enabled;
-    GList *subitems;
+    SBPage *subitems;
+    /* where the item is, maintained by the SBPage functions */
+    SBPage *page;
+    guint slot;
+    SBPool *pool;
 } SBItem;
 
-char *sbitem_get_display_name(SBItem *item);
-char *sbitem_get_display_identifier(SBItem *item);
-char *sbitem_get_icon_filename(SBItem *item);
+const char *sbitem_intern_string_val(plist_t icon_info, const char *key);
+const char *sbitem_get_display_name(SBItem *item);
+const char *sbitem_get_display_identifier(SBItem *item);
+void sbitem_set_display_name(SBItem *item, const char *display_name);
+gboolean sbitem_update_icon_mod_date(SBItem *item, const GTimeVal *mod_date);
+plist_t sbitem_get_node(SBItem *item);
+const char *sbitem_get_extra(SBItem *item, guint32 *length);
+const char *sbitem_get_icon_filename(SBItem *item);
+char *sbitem_build_icon_filename(const char *display_identifier);
+
+void sbitem_set_pool(SBPool *pool);
+void sbitem_set_destroy_notify(GDestroyNotify func);
 
 SBItem *sbitem_new(plist_t icon_info);
-SBItem *sbitem_new_with_subitems(plist_t icon_info, GList *subitems);
+SBItem *sbitem_new_with_subitems(plist_t icon_info, SBPage *subitems);
 void sbitem_free(SBItem *item);
+void sbitem_release(SBItem *item);
 
 void g_func_sbitem_free(SBItem *item, gpointer data);
 
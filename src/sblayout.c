@@ -0,0 +1,224 @@
+/**
+ * sblayout.c
+ * Persistent layout snapshots for undo/redo
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+ #include <config.h>
+#endif
+
+#include <string.h>
+
+#include "sblayout.h"
+
+/*
+ * Snapshots never copy what did not change: a page whose contents are
+ * the same as in the previous snapshot just takes another reference on
+ * the node of that snapshot. An edit usually touches one or two pages,
+ * so that is all the memory a history step costs.
+ */
+
+static void sblayout_node_unref(SBLayoutNode *node)
+{
+    guint i;
+
+    if (!node || !g_atomic_int_dec_and_test(&node->ref_count)) {
+        return;
+    }
+    if (node->folders) {
+        for (i = 0; i < node->count; i++) {
+            sblayout_node_unref(node->folders[i]);
+        }
+        g_free(node->folders);
+    }
+    g_free(node);
+}
+
+static SBLayoutNode *sblayout_node_ref(SBLayoutNode *node)
+{
+    g_atomic_int_inc(&node->ref_count);
+    return node;
+}
+
+static gboolean sblayout_node_matches(SBLayoutNode *node, SBPage *page)
+{
+    guint i;
+
+    if (!node || (node->count != page->count)) {
+        return FALSE;
+    }
+    if (memcmp(node->items, page->items, page->count * sizeof(SBItem*)) != 0) {
+        return FALSE;
+    }
+    for (i = 0; i < page->count; i++) {
+        SBItem *item = page->items[i];
+        if (item->is_folder && item->subitems) {
+            if (!node->folders || !sblayout_node_matches(node->folders[i], item->subitems)) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+static SBLayoutNode *sblayout_node_new(SBPage *page, SBLayoutNode *prev)
+{
+    SBLayoutNode *node;
+    guint i, j;
+
+    if (sblayout_node_matches(prev, page)) {
+        return sblayout_node_ref(prev);
+    }
+
+    /* the item pointers live right behind the node */
+    node = g_malloc(sizeof(SBLayoutNode) + page->count * sizeof(SBItem*));
+    node->ref_count = 1;
+    node->count = page->count;
+    node->items = (SBItem**)(node + 1);
+    node->folders = NULL;
+    memcpy(node->items, page->items, page->count * sizeof(SBItem*));
+
+    for (i = 0; i < page->count; i++) {
+        SBItem *item = page->items[i];
+        SBLayoutNode *prev_folder = NULL;
+        if (!item->is_folder || !item->subitems) {
+            continue;
+        }
+        if (!node->folders) {
+            node->folders = g_new0(SBLayoutNode*, page->count);
+        }
+        /* the folder might have been moved to another slot */
+        for (j = 0; prev && prev->folders && (j < prev->count); j++) {
+            if (prev->items[j] == item) {
+                prev_folder = prev->folders[j];
+                break;
+            }
+        }
+        node->folders[i] = sblayout_node_new(item->subitems, prev_folder);
+    }
+
+    return node;
+}
+
+/**
+ * Takes a snapshot of the given dock and pages, sharing everything that
+ * did not change since prev.
+ *
+ * @param dock The dock.
+ * @param pages The pages, an array of SBPage.
+ * @param prev The previous snapshot or NULL.
+ *
+ * @return A new snapshot, release it with sblayout_unref().
+ */
+SBLayout *sblayout_new(SBPage *dock, GPtrArray *pages, SBLayout *prev)
+{
+    SBLayout *layout;
+    guint i;
+
+    layout = g_malloc(sizeof(SBLayout) + pages->len * sizeof(SBLayoutNode*));
+    layout->ref_count = 1;
+    layout->page_count = pages->len;
+    layout->pages = (SBLayoutNode**)(layout + 1);
+    layout->dock = sblayout_node_new(dock, prev ? prev->dock : NULL);
+
+    for (i = 0; i < pages->len; i++) {
+        SBLayoutNode *prev_page = NULL;
+        if (prev && (i < prev->page_count)) {
+            prev_page = prev->pages[i];
+        }
+        layout->pages[i] = sblayout_node_new((SBPage*)g_ptr_array_index(pages, i), prev_page);
+    }
+
+    return layout;
+}
+
+SBLayout *sblayout_ref(SBLayout *layout)
+{
+    g_atomic_int_inc(&layout->ref_count);
+    return layout;
+}
+
+void sblayout_unref(SBLayout *layout)
+{
+    guint i;
+
+    if (!layout || !g_atomic_int_dec_and_test(&layout->ref_count)) {
+        return;
+    }
+    sblayout_node_unref(layout->dock);
+    for (i = 0; i < layout->page_count; i++) {
+        sblayout_node_unref(layout->pages[i]);
+    }
+    g_free(layout);
+}
+
+/**
+ * Checks if two snapshots describe the same layout. As unchanged pages
+ * are shared this only needs to compare the node pointers.
+ */
+gboolean sblayout_equal(SBLayout *a, SBLayout *b)
+{
+    guint i;
+
+    if (a == b) {
+        return TRUE;
+    }
+    if (!a || !b || (a->dock != b->dock) || (a->page_count != b->page_count)) {
+        return FALSE;
+    }
+    for (i = 0; i < a->page_count; i++) {
+        if (a->pages[i] != b->pages[i]) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+SBLayoutNode *sblayout_node_get_folder(SBLayoutNode *node, guint index)
+{
+    if (!node || !node->folders || (index >= node->count)) {
+        return NULL;
+    }
+    return node->folders[index];
+}
+
+/**
+ * Replaces the contents of page with the items of node. Folder contents
+ * are left alone, use sblayout_node_get_folder() to restore them.
+ *
+ * @return TRUE if the contents of page changed, FALSE otherwise.
+ */
+gboolean sblayout_node_apply(SBLayoutNode *node, SBPage *page)
+{
+    guint i;
+
+    if ((node->count == page->count) && (memcmp(node->items, page->items, page->count * sizeof(SBItem*)) == 0)) {
+        return FALSE;
+    }
+    sbpage_clear(page);
+    for (i = 0; i < node->count; i++) {
+        sbpage_append_item(page, node->items[i]);
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,60 @@
+/**
+ * sblayout.h
+ * Persistent layout snapshots for undo/redo (header file)
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifndef SBLAYOUT_H
+#define SBLAYOUT_H
+
+#include <glib.h>
+#include "sbitem.h"
+#include "sbpage.h"
+
+typedef struct _SBLayoutNode SBLayoutNode;
+
+/* immutable copy of the contents of a page, shared between snapshots */
+struct _SBLayoutNode {
+    gint ref_count;
+    guint count;
+    SBItem **items;
+    /* contents of the folders in items, NULL if there are none */
+    SBLayoutNode **folders;
+};
+
+/* the dock and all pages at one point in time */
+typedef struct {
+    gint ref_count;
+    SBLayoutNode *dock;
+    guint page_count;
+    SBLayoutNode **pages;
+} SBLayout;
+
+SBLayout *sblayout_new(SBPage *dock, GPtrArray *pages, SBLayout *prev);
+SBLayout *sblayout_ref(SBLayout *layout);
+void sblayout_unref(SBLayout *layout);
+gboolean sblayout_equal(SBLayout *a, SBLayout *b);
+
+SBLayoutNode *sblayout_node_get_folder(SBLayoutNode *node, guint index);
+gboolean sblayout_node_apply(SBLayoutNode *node, SBPage *page);
+
+#endif
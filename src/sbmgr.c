@@ -23,19 +23,35 @@
  * USA
  */
 
+#include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
+#include <sys/stat.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <plist/plist.h>
 
 #include "sbmgr.h"
 #include "device.h"
 #include "gui.h"
+#include "sbitem.h"
 #include "utility.h"
 
+/* upper limit for the data transferred by background prefetching */
+#define PREFETCH_MAX_BYTES_PER_SEC (256*1024)
+/* booked before a transfer, corrected once the real size is known */
+#define PREFETCH_ICON_ESTIMATE (8*1024)
+#define PREFETCH_WALLPAPER_ESTIMATE (128*1024)
+#define PREFETCH_ICONSTATE_ESTIMATE (32*1024)
+
 static device_info_cb_t device_info_callback = NULL;
 static finished_cb_t finished_callback = NULL;
 
+static GMutex *prefetch_mutex = NULL;
+static GHashTable *prefetch_devices = NULL;
+static gint64 prefetch_next_transfer = 0;
+
 GtkWidget *sbmgr_new()
 {
     if (!g_thread_supported())
@@ -44,6 +60,9 @@ GtkWidget *sbmgr_new()
     /* initialize device communication environment */
     device_init();
 
+    prefetch_mutex = g_mutex_new();
+    prefetch_devices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
     /* Create the clutter widget and return it */
     return gui_init();
 }
@@ -63,158 +82,151 @@ void sbmgr_load(const char *uuid, device_info_cb_t info_cb, finished_cb_t finish
     g_thread_create((GThreadFunc)gui_pages_load_cb, (gpointer)uuid, FALSE, NULL);
 }
 
-static gboolean iconstate_changed_v1(plist_t current_state, plist_t new_state)
+/* waits until the limit allows another transfer and books bytes for it */
+static void prefetch_throttle(gint64 bytes)
 {
-    if (!current_state || !new_state) {
-        return FALSE;
+    struct timeval tv;
+    gint64 now;
+    gint64 delay;
+
+    g_mutex_lock(prefetch_mutex);
+    gettimeofday(&tv, NULL);
+    now = (gint64)tv.tv_sec * G_USEC_PER_SEC + tv.tv_usec;
+    prefetch_next_transfer = MAX(prefetch_next_transfer, now);
+    delay = prefetch_next_transfer - now;
+    prefetch_next_transfer += (bytes * G_USEC_PER_SEC) / PREFETCH_MAX_BYTES_PER_SEC;
+    g_mutex_unlock(prefetch_mutex);
+
+    if (delay > 0) {
+        g_usleep(delay);
     }
-    /* compare new state with last saved state */
-    uint32_t cur_cnt = plist_array_get_size(current_state);
-    uint32_t new_cnt = plist_array_get_size(new_state);
-    debug_printf("%s: old %d, new %d\n", __func__, cur_cnt, new_cnt);
-    if (cur_cnt != new_cnt) {
-        /* number of pages has changed! */
-        debug_printf("%s: number of pages changed!\n", __func__);
-        return TRUE;
+}
+
+/* replaces what was booked for a transfer by the size of filename */
+static void prefetch_throttle_correct(gint64 booked, const char *filename)
+{
+    struct stat st;
+    gint64 bytes = 0;
+
+    if (filename && (g_stat(filename, &st) == 0)) {
+        bytes = st.st_size;
     }
+    g_mutex_lock(prefetch_mutex);
+    prefetch_next_transfer += ((bytes - booked) * G_USEC_PER_SEC) / PREFETCH_MAX_BYTES_PER_SEC;
+    g_mutex_unlock(prefetch_mutex);
+}
 
-    /* now dig deeper */
+static void prefetch_icons(sbservices_client_t sbc, plist_t node)
+{
     uint32_t i;
-    for (i = 0; i < new_cnt; i++) {
-        plist_t cur_pp = plist_array_get_item(current_state, i);
-        plist_t new_pp = plist_array_get_item(new_state, i);
-        uint32_t cur_row_cnt = plist_array_get_size(cur_pp);
-        uint32_t new_row_cnt = plist_array_get_size(new_pp);	
-        if (cur_row_cnt != new_row_cnt) {
-            fprintf(stderr, "%s: number of rows on page %d changed: old %d, new %d, this is NOT expected!\n", __func__, i, cur_row_cnt, new_row_cnt);
-            return FALSE;
+    plist_t subnode;
+    const char *display_identifier;
+
+    switch (plist_get_node_type(node)) {
+        case PLIST_ARRAY:
+        for (i = 0; i < plist_array_get_size(node); i++) {
+            prefetch_icons(sbc, plist_array_get_item(node, i));
         }
-	uint32_t j;
-        for (j = 0; j < cur_row_cnt; j++) {
-            plist_t cur_row = plist_array_get_item(cur_pp, j);
-            plist_t new_row = plist_array_get_item(new_pp, j);
-            uint32_t cur_item_cnt = plist_array_get_size(cur_row);
-            uint32_t new_item_cnt = plist_array_get_size(new_row);
-            if (cur_item_cnt != new_item_cnt) {
-                fprintf(stderr, "%s: number of items on page %d row %d changed: old %d, new %d, this is NOT expected!\n", __func__, i, j, cur_item_cnt, new_item_cnt);
-                return FALSE;
-            }
-            uint32_t k;
-            for (k = 0; k < cur_item_cnt; k++) {
-                plist_t cur_node = plist_array_get_item(cur_row, k);
-                plist_t new_node = plist_array_get_item(new_row, k);
-		if (plist_get_node_type(cur_node) != plist_get_node_type(new_node)) {
-                    /* one is an icon, the other one empty. this is a change! */
-                    return TRUE;
-                }
-                if (plist_get_node_type(cur_node) == PLIST_DICT) {
-                    /* ok, compare the displayIdentifier */
-                    plist_t cur_di = plist_dict_get_item(cur_node, "displayIdentifier");
-                    plist_t new_di = plist_dict_get_item(new_node, "displayIdentifier");
-                    if (plist_compare_node_value(cur_di, new_di) == FALSE) {
-                        debug_printf("%s: page %d row %d item %d changed!\n", __func__, i, j, k);
-                        return TRUE;
-                    }
+        break;
+        case PLIST_DICT:
+        subnode = plist_dict_get_item(node, "iconLists");
+        if (subnode) {
+            prefetch_icons(sbc, subnode);
+            break;
+        }
+        display_identifier = sbitem_intern_string_val(node, "displayIdentifier");
+        if (display_identifier) {
+            char *filename;
+            GError *error = NULL;
+
+            filename = sbitem_build_icon_filename(display_identifier);
+            if (filename && !g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
+                prefetch_throttle(PREFETCH_ICON_ESTIMATE);
+                if (device_sbs_save_icon(sbc, display_identifier, filename, &error)) {
+                    prefetch_throttle_correct(PREFETCH_ICON_ESTIMATE, filename);
+                } else {
+                    prefetch_throttle_correct(PREFETCH_ICON_ESTIMATE, NULL);
+                    debug_printf("%s: %s\n", __func__, error->message);
+                    g_error_free(error);
                 }
             }
+            g_free(filename);
         }
+        break;
+        default:
+        break;
     }
-
-    /* no change found */
-    debug_printf("%s: no change!\n", __func__);
-    return FALSE;
 }
 
-static gboolean iconstate_changed_v2(plist_t current_state, plist_t new_state)
+static gpointer sbmgr_prefetch_cb(gpointer user_data)
 {
-    if (!current_state || !new_state) {
-        return FALSE;
-    }
-
-    /* compare new state with last saved state */
-    uint32_t cur_cnt = plist_array_get_size(current_state);
-    uint32_t new_cnt = plist_array_get_size(new_state);
-    debug_printf("%s: old %d, new %d\n", __func__, cur_cnt, new_cnt);
-    if (cur_cnt != new_cnt) {
-        /* number of pages has changed! */
-        debug_printf("%s: number of pages changed!\n", __func__);
-        return TRUE;
-    }
+    char *uuid = (char*)user_data;
+    GError *error = NULL;
+    sbservices_client_t sbc;
+    uint32_t osversion = 0;
 
-    /* now dig deeper */
-    uint32_t i;
-    for (i = 0; i < new_cnt; i++) {
-        plist_t cur_pp = plist_array_get_item(current_state, i);
-        plist_t new_pp = plist_array_get_item(new_state, i);
-        if (plist_get_node_type(plist_array_get_item(new_pp, 0)) == PLIST_ARRAY) {
-            new_pp = plist_array_get_item(new_pp, 0);
-        }
-        if (plist_get_node_type(plist_array_get_item(cur_pp, 0)) == PLIST_ARRAY) {
-            cur_pp = plist_array_get_item(cur_pp, 0);
-        }
+    debug_printf("%s: prefetching %s\n", __func__, uuid);
 
-        uint32_t cur_item_cnt = plist_array_get_size(cur_pp);
-        uint32_t new_item_cnt = plist_array_get_size(new_pp);	
-        if (cur_item_cnt != new_item_cnt) {
-            fprintf(stderr, "%s: number of items on page %d changed: old %d, new %d\n", __func__, i, cur_item_cnt, new_item_cnt);
-            return TRUE;
+    sbc = device_sbs_new(uuid, &osversion, &error);
+    if (sbc) {
+        plist_t iconstate = NULL;
+        const char *fmt_version = NULL;
+#ifdef HAVE_LIBIMOBILEDEVICE_1_1
+        if (osversion >= 0x04000000) {
+            fmt_version = "2";
         }
-        uint32_t k;
-        for (k = 0; k < cur_item_cnt; k++) {
-            plist_t cur_node = plist_array_get_item(cur_pp, k);
-            plist_t new_node = plist_array_get_item(new_pp, k);
-            if (plist_get_node_type(cur_node) == PLIST_DICT) {
-                /* ok, compare the displayIdentifier */
-                plist_t cur_di = plist_dict_get_item(cur_node, "displayIdentifier");
-                plist_t new_di = plist_dict_get_item(new_node, "displayIdentifier");
-                if (!cur_di && !new_di) {
-                    cur_di = plist_dict_get_item(cur_node, "displayName");
-                    new_di = plist_dict_get_item(new_node, "displayName");
-                    if (plist_compare_node_value(cur_di, new_di) == FALSE) {
-                        debug_printf("%s: page %d folder item %d displayName changed!\n", __func__, i, k);
-                        return TRUE;
-                    }
-                    cur_di = plist_dict_get_item(cur_node, "iconLists");
-                    new_di = plist_dict_get_item(new_node, "iconLists");
-                    cur_di = plist_array_get_item(cur_di, 0);
-                    new_di = plist_array_get_item(new_di, 0);
-                    if (plist_array_get_size(cur_di) != plist_array_get_size(new_di)) {
-                        debug_printf("%s: page %d folder item %d subitem count changed!\n", __func__, i, k);
-                        return TRUE;
-                    }
-                    uint32_t j;
-                    for (j = 0; j < plist_array_get_size(cur_di); j++) {
-                        plist_t cur_si = plist_array_get_item(cur_di, j);
-                        plist_t new_si = plist_array_get_item(new_di, j);
-                        if (plist_compare_node_value(cur_si, new_si) == FALSE) {
-                            debug_printf("%s: page %d folder item %d subitem %d changed!\n", __func__, i, k, j);
-                            return TRUE;
-                        }
-                    }
-                } else if ((!cur_di && new_di) || (cur_di && !new_di)) {
-                    debug_printf("%s: page %d item %d changed!\n", __func__, i, k);
-                    return TRUE;
-                } else {
-                    if (plist_compare_node_value(cur_di, new_di) == FALSE) {
-                        debug_printf("%s: page %d item %d changed!\n", __func__, i, k);
-                        return TRUE;
-                    }
-                }
+        if (osversion >= 0x03020000) {
+            char *path;
+            prefetch_throttle(PREFETCH_WALLPAPER_ESTIMATE);
+            path = device_sbs_save_wallpaper(sbc, uuid, &error);
+            prefetch_throttle_correct(PREFETCH_WALLPAPER_ESTIMATE, path);
+            g_free(path);
+            if (error) {
+                debug_printf("%s: %s\n", __func__, error->message);
+                g_error_free(error);
+                error = NULL;
             }
         }
+#endif
+        /* its size on the wire is not known, the estimate stays */
+        prefetch_throttle(PREFETCH_ICONSTATE_ESTIMATE);
+        if (device_sbs_get_iconstate(sbc, &iconstate, fmt_version, &error)) {
+            device_save_cached_iconstate(uuid, iconstate, fmt_version, NULL);
+            prefetch_icons(sbc, iconstate);
+            plist_free(iconstate);
+        }
+        device_sbs_free(sbc);
     }
 
-    /* no change found */
-    debug_printf("%s: no change!\n", __func__);
-    return FALSE;
+    /* this runs in the background, so don't bother the user with errors */
+    if (error) {
+        debug_printf("%s: %s\n", __func__, error->message);
+        g_error_free(error);
+    }
+
+    debug_printf("%s: finished prefetching %s\n", __func__, uuid);
+
+    g_mutex_lock(prefetch_mutex);
+    g_hash_table_remove(prefetch_devices, uuid);
+    g_mutex_unlock(prefetch_mutex);
+
+    return NULL;
 }
 
-static gboolean iconstate_changed(plist_t current_state, plist_t new_state, const char *format_version)
+void sbmgr_prefetch(const char *uuid)
 {
-    if (format_version && (strcmp(format_version, "2") == 0)) {
-        return iconstate_changed_v2(current_state, new_state);
-    } else {
-        return iconstate_changed_v1(current_state, new_state);
+    char *prefetch_uuid = NULL;
+
+    /* only one prefetch per device at a time */
+    g_mutex_lock(prefetch_mutex);
+    if (!g_hash_table_lookup(prefetch_devices, uuid)) {
+        prefetch_uuid = g_strdup(uuid);
+        g_hash_table_insert(prefetch_devices, prefetch_uuid, prefetch_uuid);
+    }
+    g_mutex_unlock(prefetch_mutex);
+
+    if (prefetch_uuid) {
+        g_thread_create((GThreadFunc)sbmgr_prefetch_cb, prefetch_uuid, FALSE, NULL);
     }
 }
 
@@ -238,22 +250,31 @@ void sbmgr_save(const char *uuid)
         if (osversion >= 0x04000000) {
             fmt_version = "2";
         }
-        plist_t iconstate = gui_get_iconstate(fmt_version);
-        if (iconstate) {
-            device_sbs_get_iconstate(sbc, &current_state, fmt_version, &error);
-            if (error) {
-                g_printerr("%s", error->message);
-                g_error_free(error);
-                error = NULL;
-            }
-            if (iconstate_changed(current_state, iconstate, fmt_version) == TRUE) {
-                device_sbs_set_iconstate(sbc, iconstate, &error);
+        device_sbs_get_iconstate(sbc, &current_state, fmt_version, &error);
+        if (error) {
+            g_printerr("%s", error->message);
+            g_error_free(error);
+            error = NULL;
+        }
+        /* compare the device's state with what is shown */
+        if (current_state && (gui_iconstate_changed(current_state, fmt_version) == TRUE)) {
+            /* the device rejects layouts that exceed its limits */
+            gui_fit_to_device_limits();
+            plist_t iconstate = gui_get_iconstate(fmt_version);
+            if (iconstate && device_sbs_set_iconstate(sbc, iconstate, &error)) {
+                /* keep the cached layout in sync with the device */
+                const GByteArray *data = gui_get_iconstate_data(fmt_version);
+                if (data) {
+                    device_save_cached_iconstate_data(uuid, (const char*)data->data, data->len, NULL);
+                }
             }
-            if (current_state) {
-                plist_free(current_state);
+            if (iconstate) {
+                plist_free(iconstate);
             }
-            plist_free(iconstate);
-	}
+        }
+        if (current_state) {
+            plist_free(current_state);
+        }
         device_sbs_free(sbc);
     }
 
@@ -34,6 +34,7 @@ typedef void (*finished_cb_t)(gboolean success);
 GtkWidget *sbmgr_new();
 void sbmgr_load(const char *uuid, device_info_cb_t info_callback, finished_cb_t finished_callback);
 void sbmgr_save(const char *uuid);
+void sbmgr_prefetch(const char *uuid);
 void sbmgr_cleanup();
 void sbmgr_finalize();
 
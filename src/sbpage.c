@@ -0,0 +1,261 @@
+/**
+ * sbpage.c
+ * SpringBoard Page representation
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+ #include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sbpage.h"
+
+static SBPool *page_pool = NULL;
+static SBPool *slot_pool = NULL;
+
+/**
+ * Makes sbpage_new() take pages from page_pool and their slot arrays
+ * from slot_pool if they fit into one block. Pass NULL to go back to
+ * plain heap allocations.
+ */
+void sbpage_set_pools(SBPool *new_page_pool, SBPool *new_slot_pool)
+{
+    page_pool = new_page_pool;
+    slot_pool = new_slot_pool;
+}
+
+SBPage *sbpage_new(guint capacity)
+{
+    SBPage *page;
+
+    if (page_pool) {
+        page = sbpool_alloc0(page_pool);
+        page->pool = page_pool;
+    } else {
+        page = g_new0(SBPage, 1);
+    }
+
+    if (capacity < 1) {
+        capacity = 1;
+    }
+    if (slot_pool && (capacity * sizeof(SBItem*) <= sbpool_get_block_size(slot_pool))) {
+        page->items = sbpool_alloc0(slot_pool);
+        page->slot_pool = slot_pool;
+        capacity = sbpool_get_block_size(slot_pool) / sizeof(SBItem*);
+    } else {
+        page->items = g_new0(SBItem*, capacity);
+    }
+    page->count = 0;
+    page->capacity = capacity;
+    page->index = -1;
+
+    return page;
+}
+
+static void sbpage_free_slots(SBPage *page)
+{
+    if (page->slot_pool) {
+        sbpool_release(page->slot_pool, page->items);
+        page->slot_pool = NULL;
+    } else {
+        g_free(page->items);
+    }
+    page->items = NULL;
+}
+
+void sbpage_free(SBPage *page, gboolean free_items)
+{
+    if (page) {
+        guint i;
+        for (i = 0; i < page->count; i++) {
+            if (free_items) {
+                sbitem_free(page->items[i]);
+            } else if (page->items[i]->page == page) {
+                page->items[i]->page = NULL;
+            }
+        }
+        sbpage_free_slots(page);
+        if (page->pool) {
+            sbpool_release(page->pool, page);
+        } else {
+            g_free(page);
+        }
+    }
+}
+
+/**
+ * Like sbpage_free(), but leaves the blocks that come from the pools
+ * alone, they go away with the next sbpool_reset().
+ */
+void sbpage_release(SBPage *page, gboolean release_items)
+{
+    if (page) {
+        guint i;
+        if (release_items) {
+            for (i = 0; i < page->count; i++) {
+                sbitem_release(page->items[i]);
+            }
+        }
+        if (!page->slot_pool) {
+            g_free(page->items);
+        }
+        page->items = NULL;
+        if (!page->pool) {
+            g_free(page);
+        }
+    }
+}
+
+void g_func_sbpage_free(SBPage *page, gpointer data)
+{
+    sbpage_free(page, TRUE);
+}
+
+SBItem *sbpage_get_item(SBPage *page, guint index)
+{
+    if (!page || (index >= page->count)) {
+        return NULL;
+    }
+    return page->items[index];
+}
+
+static void sbpage_update_slots(SBPage *page, guint first, guint last)
+{
+    guint i;
+
+    for (i = first; i < last; i++) {
+        page->items[i]->page = page;
+        page->items[i]->slot = i;
+    }
+}
+
+/* puts item into an existing slot and returns the item that was there */
+SBItem *sbpage_set_item(SBPage *page, guint index, SBItem *item)
+{
+    SBItem *old;
+
+    if (!page || !item || (index >= page->count)) {
+        return NULL;
+    }
+    old = page->items[index];
+    old->page = NULL;
+    page->items[index] = item;
+    sbpage_update_slots(page, index, index + 1);
+
+    return old;
+}
+
+static void sbpage_reserve(SBPage *page, guint count)
+{
+    if (count <= page->capacity) {
+        return;
+    }
+    /* pages are sized to the device limits, this only happens while dragging */
+    while (page->capacity < count) {
+        page->capacity *= 2;
+    }
+    if (page->slot_pool) {
+        SBItem **items = g_new0(SBItem*, page->capacity);
+        memcpy(items, page->items, page->count * sizeof(SBItem*));
+        sbpage_free_slots(page);
+        page->items = items;
+    } else {
+        page->items = g_renew(SBItem*, page->items, page->capacity);
+    }
+}
+
+void sbpage_append_item(SBPage *page, SBItem *item)
+{
+    sbpage_insert_item(page, item, page->count);
+}
+
+void sbpage_insert_item(SBPage *page, SBItem *item, guint index)
+{
+    if (!page || !item) {
+        return;
+    }
+    if (index > page->count) {
+        index = page->count;
+    }
+    sbpage_reserve(page, page->count + 1);
+    memmove(&page->items[index + 1], &page->items[index], (page->count - index) * sizeof(SBItem*));
+    page->items[index] = item;
+    page->count++;
+    sbpage_update_slots(page, index, page->count);
+}
+
+SBItem *sbpage_remove_index(SBPage *page, guint index)
+{
+    SBItem *item;
+
+    if (!page || (index >= page->count)) {
+        return NULL;
+    }
+    item = page->items[index];
+    page->count--;
+    memmove(&page->items[index], &page->items[index + 1], (page->count - index) * sizeof(SBItem*));
+    page->items[page->count] = NULL;
+    sbpage_update_slots(page, index, page->count);
+    item->page = NULL;
+
+    return item;
+}
+
+gint sbpage_index_of(SBPage *page, SBItem *item)
+{
+    /* items know their slot, no need to search */
+    if (!page || !item || (item->page != page) || (item->slot >= page->count) || (page->items[item->slot] != item)) {
+        return -1;
+    }
+    return (gint)item->slot;
+}
+
+gboolean sbpage_remove_item(SBPage *page, SBItem *item)
+{
+    gint index = sbpage_index_of(page, item);
+
+    if (index < 0) {
+        return FALSE;
+    }
+    sbpage_remove_index(page, index);
+    return TRUE;
+}
+
+void sbpage_clear(SBPage *page)
+{
+    guint i;
+
+    if (!page) {
+        return;
+    }
+    /* items that moved to another page already point there */
+    for (i = 0; i < page->count; i++) {
+        if (page->items[i]->page == page) {
+            page->items[i]->page = NULL;
+        }
+        page->items[i] = NULL;
+    }
+    page->count = 0;
+}
@@ -0,0 +1,63 @@
+/**
+ * sbpage.h
+ * SpringBoard Page representation (header file)
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifndef SBPAGE_H
+#define SBPAGE_H
+
+#include <glib.h>
+#include "sbitem.h"
+#include "sbpool.h"
+
+/* a page, the dock or the contents of a folder: a slot array of items */
+struct _SBPage {
+    SBItem **items;
+    guint count;
+    guint capacity;
+    /* position in the page list, -1 for the dock and folders */
+    gint index;
+    /* the folder this page belongs to, if any */
+    SBItem *folder;
+    SBPool *pool;
+    SBPool *slot_pool;
+};
+
+void sbpage_set_pools(SBPool *page_pool, SBPool *slot_pool);
+
+SBPage *sbpage_new(guint capacity);
+void sbpage_free(SBPage *page, gboolean free_items);
+void sbpage_release(SBPage *page, gboolean release_items);
+
+SBItem *sbpage_get_item(SBPage *page, guint index);
+SBItem *sbpage_set_item(SBPage *page, guint index, SBItem *item);
+void sbpage_append_item(SBPage *page, SBItem *item);
+void sbpage_insert_item(SBPage *page, SBItem *item, guint index);
+SBItem *sbpage_remove_index(SBPage *page, guint index);
+gint sbpage_index_of(SBPage *page, SBItem *item);
+gboolean sbpage_remove_item(SBPage *page, SBItem *item);
+void sbpage_clear(SBPage *page);
+
+void g_func_sbpage_free(SBPage *page, gpointer data);
+
+#endif
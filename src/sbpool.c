@@ -0,0 +1,114 @@
+/**
+ * sbpool.c
+ * Fixed size block pool
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifdef HAVE_CONFIG_H
+ #include <config.h>
+#endif
+
+#include <string.h>
+
+#include "sbpool.h"
+
+struct _SBPool {
+    gsize block_size;
+    guint blocks_per_chunk;
+    GPtrArray *chunks;
+    /* chunk and block the next fresh block is taken from */
+    guint chunk;
+    guint block;
+    /* released blocks, linked through their first word */
+    gpointer free_list;
+};
+
+SBPool *sbpool_new(gsize block_size, guint blocks_per_chunk)
+{
+    SBPool *pool = g_new0(SBPool, 1);
+
+    /* every block must be able to hold the free list link */
+    block_size = MAX(block_size, sizeof(gpointer));
+    pool->block_size = (block_size + sizeof(gpointer) - 1) & ~(sizeof(gpointer) - 1);
+    pool->blocks_per_chunk = MAX(blocks_per_chunk, 1);
+    pool->chunks = g_ptr_array_new();
+
+    return pool;
+}
+
+void sbpool_free(SBPool *pool)
+{
+    if (pool) {
+        g_ptr_array_foreach(pool->chunks, (GFunc)g_free, NULL);
+        g_ptr_array_free(pool->chunks, TRUE);
+        g_free(pool);
+    }
+}
+
+gpointer sbpool_alloc0(SBPool *pool)
+{
+    gpointer block;
+
+    if (pool->free_list) {
+        block = pool->free_list;
+        pool->free_list = *(gpointer*)block;
+    } else {
+        if (pool->block >= pool->blocks_per_chunk) {
+            pool->chunk++;
+            pool->block = 0;
+        }
+        if (pool->chunk >= pool->chunks->len) {
+            g_ptr_array_add(pool->chunks, g_malloc(pool->block_size * pool->blocks_per_chunk));
+        }
+        block = (char*)g_ptr_array_index(pool->chunks, pool->chunk) + pool->block * pool->block_size;
+        pool->block++;
+    }
+    memset(block, '\0', pool->block_size);
+
+    return block;
+}
+
+void sbpool_release(SBPool *pool, gpointer block)
+{
+    if (block) {
+        *(gpointer*)block = pool->free_list;
+        pool->free_list = block;
+    }
+}
+
+void sbpool_reset(SBPool *pool)
+{
+    /* all blocks become available again, the chunks are kept for reuse */
+    pool->free_list = NULL;
+    pool->chunk = 0;
+    pool->block = 0;
+}
+
+gsize sbpool_get_block_size(SBPool *pool)
+{
+    return pool->block_size;
+}
+
+guint sbpool_get_chunk_count(SBPool *pool)
+{
+    return pool->chunks->len;
+}
@@ -0,0 +1,44 @@
+/**
+ * sbpool.h
+ * Fixed size block pool (header file)
+ *
+ * Copyright (C) 2009-2010 Nikias Bassen <nikias@gmx.li>
+ * Copyright (C) 2009-2010 Martin Szulecki <opensuse@sukimashita.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more profile.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 
+ * USA
+ */
+
+#ifndef SBPOOL_H
+#define SBPOOL_H
+
+#include <glib.h>
+
+/* hands out equally sized blocks carved from a few large chunks */
+typedef struct _SBPool SBPool;
+
+SBPool *sbpool_new(gsize block_size, guint blocks_per_chunk);
+void sbpool_free(SBPool *pool);
+
+gpointer sbpool_alloc0(SBPool *pool);
+void sbpool_release(SBPool *pool, gpointer block);
+void sbpool_reset(SBPool *pool);
+
+gsize sbpool_get_block_size(SBPool *pool);
+guint sbpool_get_chunk_count(SBPool *pool);
+
+#endif